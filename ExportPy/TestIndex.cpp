@@ -0,0 +1,95 @@
+/*
+    Writes the index used by test/test_archiveexport.py into the current directory:
+
+        TestIndex
+
+    Channels "CH:00" .. "CH:39" hold 10 samples each, value i at TEST_START + i
+    seconds, and every channel has its own data file. "ALARM" holds one sample
+    per entry of alarm_samples, mostly with a status that differs from the
+    severity. All channels have the limits of info in main(). See test.sh.
+*/
+
+/* C */
+#include <stdio.h>
+#include <string.h>
+
+/* Tools */
+#include <AutoPtr.h>
+#include <GenericException.h>
+
+/* Storage */
+#include <DataFile.h>
+#include <DataWriter.h>
+#include <IndexFile.h>
+
+static const epicsUInt32 start_seconds = 1000000000; // TEST_START in the test, since 1990
+static const size_t channel_count = 40;
+static const size_t channel_samples = 10;
+
+static const struct {
+    double value;
+    short status, severity;
+} alarm_samples[] = {
+    { 0.0, 0, 0 },  // NO_ALARM, NO_ALARM
+    { 8.5, 4, 1 },  // HIGH, MINOR
+    { 9.5, 3, 2 },  // HIHI, MAJOR
+    { -9.5, 5, 2 }  // LOLO, MAJOR
+};
+
+static void writeChannel(IndexFile &index, const char *channel_name, const char *data_file_name, const CtrlInfo &info,
+                         const double *values, const short *status, const short *severity, size_t count)
+{
+    DataWriter::data_file_name_base = data_file_name;
+    AutoPtr<DataWriter> writer(new DataWriter(index, channel_name, info, DBR_TIME_DOUBLE, 1, 1.0, count));
+    RawValueAutoPtr data(RawValue::allocate(DBR_TIME_DOUBLE, 1, 1));
+    epicsTimeStamp stamp;
+    stamp.secPastEpoch = start_seconds;
+    stamp.nsec = 0;
+    for (size_t i = 0; i < count; ++i){
+        memset(data, 0, RawValue::getSize(DBR_TIME_DOUBLE, 1));
+        data->value = values[i];
+        RawValue::setStatus(data, status ? status[i] : 0, severity ? severity[i] : 0);
+        RawValue::setTime(data, epicsTime(stamp) + (double) i);
+        if (!writer->add(data))
+            throw GenericException(__FILE__, __LINE__, "Cannot add sample %zu of '%s'", i, channel_name);
+    }
+}
+
+int main()
+{
+    try{
+        IndexFile index(50);
+        index.open("index", false);
+
+        CtrlInfo info;
+        info.setNumeric(2, "mA", -10.0, 10.0, -9.0, -8.0, 8.0, 9.0);
+
+        double values[channel_samples];
+        for (size_t i = 0; i < channel_samples; ++i)
+            values[i] = (double) i;
+        for (size_t c = 0; c < channel_count; ++c){
+            // one data file per channel
+            char channel_name[10], data_file_name[10];
+            snprintf(channel_name, sizeof(channel_name), "CH:%02zu", c);
+            snprintf(data_file_name, sizeof(data_file_name), "CH_%02zu", c);
+            writeChannel(index, channel_name, data_file_name, info, values, 0, 0, channel_samples);
+        }
+
+        const size_t alarm_count = sizeof(alarm_samples) / sizeof(alarm_samples[0]);
+        double alarm_values[alarm_count];
+        short status[alarm_count], severity[alarm_count];
+        for (size_t i = 0; i < alarm_count; ++i){
+            alarm_values[i] = alarm_samples[i].value;
+            status[i] = alarm_samples[i].status;
+            severity[i] = alarm_samples[i].severity;
+        }
+        writeChannel(index, "ALARM", "ALARM", info, alarm_values, status, severity, alarm_count);
+
+        DataFile::close_all();
+        index.close();
+    }catch (GenericException &e){
+        fprintf(stderr, "Error:\n%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
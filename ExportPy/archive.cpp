@@ -0,0 +1,300 @@
+/* #define AE_DEBUG */
+
+/* Tools */
+#include <AutoPtr.h>
+#include <GenericException.h>
+
+/* Storage */
+#include <RawDataReader.h>
+#include <ReaderFactory.h>
+
+#include "archive.h"
+
+/* Cached reader of a channel with the arguments it was created for */
+struct Archive::Reader
+{
+    Reader(Index &index, ReaderFactory::How how, double delta)
+        : how(how), delta(delta), last_use(0), reader(ReaderFactory::create(index, how, delta))
+    {}
+
+    ReaderFactory::How how;
+    double delta;
+    unsigned long last_use; // value of Archive::reader_uses when last used
+    AutoPtr<DataReader> reader;
+};
+
+/* SampleCursor with its own reader */
+struct Archive::Cursor
+{
+    Cursor(Index &index, const stdString &channel_name,
+           const epicsTime &start, const epicsTime &end,
+           ReaderFactory::How how, double delta, size_t max_samples)
+        : reader(ReaderFactory::create(index, how, delta)),
+          samples(*reader, channel_name, start, end, max_samples)
+    {}
+
+    AutoPtr<DataReader> reader;
+    SampleCursor samples;
+};
+
+Archive::Archive(const stdString &index_name)
+    : index_name(index_name), scanned(index), reader_uses(0), next_cursor(0), task(0), done(false), quit(false), open(false)
+{
+    try{
+        thread = std::thread(&Archive::threadMain, this);
+    }catch (std::exception &e){
+        throw GenericException(__FILE__, __LINE__, "Cannot start archive thread: %s", e.what());
+    }
+    open = true;
+
+    try{
+        run([this](){ index.open(this->index_name, true); });
+    }catch (...){
+        close();
+        throw;
+    }
+}
+
+Archive::~Archive()
+{
+    close();
+}
+
+void Archive::close()
+{
+    std::lock_guard<std::mutex> call_guard(call_mutex);
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!open)
+            return;
+        open = false;
+        quit = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+bool Archive::isOpen() const
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return open;
+}
+
+void Archive::readChannels(const std::vector<stdString> &channel_names,
+                           const epicsTime &start, const epicsTime &end,
+                           std::vector<ChannelSamples> &samples,
+                           ReaderFactory::How how, double delta, size_t max_samples,
+                           QueryControl *control)
+{
+    samples.clear();
+    samples.resize(channel_names.size());
+
+    run([&](){
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            readChannelSamples(getReader(channel_names[i], how, delta), channel_names[i], start, end, samples[i], max_samples,
+                               control);
+        }
+    }, control);
+}
+
+void Archive::readMatchingChannels(const stdString &pattern,
+                                   const epicsTime &start, const epicsTime &end,
+                                   std::vector<stdString> &channel_names,
+                                   std::vector<ChannelSamples> &samples,
+                                   ReaderFactory::How how, double delta, size_t max_samples,
+                                   QueryControl *control)
+{
+    channel_names.clear();
+    samples.clear();
+
+    run([&](){
+        scanned.scan(pattern, channel_names);
+        samples.resize(channel_names.size());
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            readChannelSamples(getReader(channel_names[i], how, delta), channel_names[i], start, end, samples[i], max_samples,
+                               control);
+        }
+    }, control);
+}
+
+void Archive::readValuesAt(const stdString &channel_name, const std::vector<epicsTime> &times,
+                           ChannelSamples &samples, std::vector<bool> &valid)
+{
+    run([&](){
+        // ReaderFactory creates a RawDataReader for ReaderFactory::Raw
+        RawDataReader &reader = static_cast<RawDataReader &>(getReader(channel_name, ReaderFactory::Raw, 0.0));
+        ::readValuesAt(reader, channel_name, times, samples, valid);
+    });
+}
+
+void Archive::estimateChannels(const std::vector<stdString> &channel_names,
+                               const epicsTime &start, const epicsTime &end,
+                               std::vector<ChannelEstimate> &estimates)
+{
+    estimates.clear();
+    estimates.resize(channel_names.size());
+
+    run([&](){
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            estimateChannel(index, channel_names[i], start, end, estimates[i]);
+        }
+    });
+}
+
+void Archive::catalogChannels(const stdString &pattern, std::vector<stdString> &channel_names,
+                              std::vector<ChannelCatalog> &catalogs)
+{
+    channel_names.clear();
+    catalogs.clear();
+
+    run([&](){
+        ScannedIndex matches(index);
+        matches.scan(pattern, channel_names);
+        catalogs.resize(channel_names.size());
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            catalogChannel(matches, channel_names[i], catalogs[i]);
+        }
+    });
+}
+
+void Archive::listChannels(const stdString &pattern, std::vector<stdString> &channel_names)
+{
+    run([&](){
+        ::listChannels(index, pattern, channel_names);
+    });
+}
+
+size_t Archive::openCursor(const stdString &channel_name,
+                           const epicsTime &start, const epicsTime &end,
+                           ReaderFactory::How how, double delta, size_t max_samples)
+{
+    size_t id = 0;
+    run([&](){
+        AutoPtr<Cursor> cursor(new Cursor(scanned, channel_name, start, end, how, delta, max_samples));
+        id = ++next_cursor;
+        cursors.insert(std::make_pair(id, (Cursor *) cursor));
+        cursor.release();
+    });
+    return id;
+}
+
+bool Archive::readCursor(size_t cursor, size_t max_samples, ChannelSamples &samples)
+{
+    bool more = false;
+    run([&](){
+        std::map<size_t, Cursor *>::iterator i = cursors.find(cursor);
+        if (i == cursors.end())
+            throw GenericException(__FILE__, __LINE__, "Unknown cursor %zu.", cursor);
+        more = i->second->samples.read(samples, max_samples);
+    });
+    return more;
+}
+
+void Archive::closeCursor(size_t cursor)
+{
+    if (!isOpen())
+        return; // closing the archive deleted the cursor
+
+    try{
+        run([&](){
+            std::map<size_t, Cursor *>::iterator i = cursors.find(cursor);
+            if (i != cursors.end()){
+                delete i->second;
+                cursors.erase(i);
+            }
+        });
+    }catch (std::exception &e){
+        // archive closed meanwhile, which deleted the cursor
+    }
+}
+
+DataReader &Archive::getReader(const stdString &channel_name, ReaderFactory::How how, double delta)
+{
+    ++reader_uses;
+    std::map<stdString, Reader *>::iterator i = readers.find(channel_name);
+    if (i != readers.end()){
+        if (i->second->how == how && i->second->delta == delta){
+            i->second->last_use = reader_uses;
+            return *i->second->reader;
+        }
+        // keep one reader per channel, zooming through many deltas would pile them up
+        delete i->second;
+        readers.erase(i);
+    }
+
+    // make room by closing the reader used least recently,
+    // deleting it also closes its data files (see ~RawDataReader)
+    if (readers.size() >= max_readers){
+        std::map<stdString, Reader *>::iterator oldest = readers.begin();
+        for (i = readers.begin(); i != readers.end(); ++i){
+            if (i->second->last_use < oldest->second->last_use)
+                oldest = i;
+        }
+        delete oldest->second;
+        readers.erase(oldest);
+    }
+
+    AutoPtr<Reader> reader(new Reader(scanned, how, delta));
+    reader->last_use = reader_uses;
+    readers.insert(std::make_pair(channel_name, (Reader *) reader));
+    return *reader.release()->reader;
+}
+
+void Archive::run(const std::function<void ()> &task, QueryControl *control)
+{
+    std::lock_guard<std::mutex> call_guard(call_mutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!open)
+        throw GenericException(__FILE__, __LINE__, "Archive '%s' is closed.", index_name.c_str());
+
+    this->task = &task;
+    done = false;
+    cond.notify_all();
+    if (control)
+        control->wait(lock, cond, [this](){ return done; });
+    else
+        cond.wait(lock, [this](){ return done; });
+    this->task = 0;
+
+    std::exception_ptr task_error = error;
+    error = nullptr;
+    if (task_error)
+        std::rethrow_exception(task_error);
+}
+
+void Archive::threadMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        cond.wait(lock, [this](){ return quit || (task && !done); });
+        if (quit)
+            break;
+
+        // the caller waits until done, so task stays valid without the lock
+        lock.unlock();
+        std::exception_ptr task_error;
+        try{
+            (*task)();
+        }catch (...){
+            task_error = std::current_exception();
+        }
+        lock.lock();
+
+        error = task_error;
+        done = true;
+        cond.notify_all();
+    }
+    lock.unlock();
+
+    // close everything in the thread that opened it,
+    // deleting the last reader also closes the data files (see ~RawDataReader)
+    std::map<size_t, Cursor *>::iterator c;
+    for (c = cursors.begin(); c != cursors.end(); ++c)
+        delete c->second;
+    cursors.clear();
+    std::map<stdString, Reader *>::iterator i;
+    for (i = readers.begin(); i != readers.end(); ++i)
+        delete i->second;
+    readers.clear();
+    index.close();
+}
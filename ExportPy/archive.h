@@ -0,0 +1,171 @@
+#ifndef _AE_ARCHIVE_H_
+#define _AE_ARCHIVE_H_
+
+// C++
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tools
+#include <NoCopy.h>
+#include <stdString.h>
+
+// Storage
+#include <IndexFile.h>
+#include <DataReader.h>
+#include <ReaderFactory.h>
+
+#include "query.h"
+
+/*
+    An index that stays open across queries, see archiveexport.Archive.
+
+    The index, a reader for each of the last max_readers channels (which keeps
+    the channel's RTree with its node cache and the current data block, it is
+    replaced when a query uses another reader type or delta) and their data
+    files stay open until close() is called. Reading another channel closes
+    the reader that was used least recently, so querying many channels through
+    one Archive does not pile up open files. Since data files are cached per thread (see DataFile),
+    all file access of an Archive is done by its own thread: queries are handed
+    over to it one at a time, the calling thread waits for the result.
+
+    Every query re-reads the root of a channel's RTree, see RTree::refresh(),
+    so data that ArchiveEngine adds to the index in the meantime is found.
+*/
+class Archive
+{
+public:
+    /*
+        Opens the index in readonly mode.
+        Throws GenericException on error.
+    */
+    Archive(const stdString &index_name);
+
+    /* Closes the archive, see close() */
+    ~Archive();
+
+    /*
+        Closes readers, data files and the index. Waits for a running query
+        to finish. Closing a closed archive does nothing.
+    */
+    void close();
+
+    bool isOpen() const;
+
+    const stdString &getIndexName() const { return index_name; }
+
+    /* Number of channels whose reader is kept open across queries */
+    static const size_t max_readers = 16;
+
+    /*
+        Same as readChannels() from query.h, using the cached readers.
+        The calling thread polls control while the archive thread reads.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void readChannels(const std::vector<stdString> &channel_names,
+                      const epicsTime &start, const epicsTime &end,
+                      std::vector<ChannelSamples> &samples,
+                      ReaderFactory::How how = ReaderFactory::Raw, double delta = 0.0,
+                      size_t max_samples = 0, QueryControl *control = 0);
+
+    /*
+        Same as readMatchingChannels() from query.h, using the cached readers.
+        Readers created for the matches resolve them from the scanned entries.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void readMatchingChannels(const stdString &pattern,
+                              const epicsTime &start, const epicsTime &end,
+                              std::vector<stdString> &channel_names,
+                              std::vector<ChannelSamples> &samples,
+                              ReaderFactory::How how = ReaderFactory::Raw, double delta = 0.0,
+                              size_t max_samples = 0, QueryControl *control = 0);
+
+    /*
+        Same as readValuesAt() from query.h, using the cached raw reader.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void readValuesAt(const stdString &channel_name, const std::vector<epicsTime> &times,
+                      ChannelSamples &samples, std::vector<bool> &valid);
+
+    /*
+        Same as estimateChannels() from query.h.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void estimateChannels(const std::vector<stdString> &channel_names,
+                          const epicsTime &start, const epicsTime &end,
+                          std::vector<ChannelEstimate> &estimates);
+
+    /*
+        Same as catalogChannels() from query.h, always in the archive thread.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void catalogChannels(const stdString &pattern, std::vector<stdString> &channel_names,
+                         std::vector<ChannelCatalog> &catalogs);
+
+    /*
+        Same as listChannels() from query.h.
+        Throws GenericException on error or if the archive is closed.
+    */
+    void listChannels(const stdString &pattern, std::vector<stdString> &channel_names);
+
+    /*
+        Opens a cursor for reading channel_name in chunks, see SampleCursor.
+        The cursor has its own reader, so other queries do not move it.
+        Returns the id of the cursor.
+        Throws GenericException on error or if the archive is closed.
+    */
+    size_t openCursor(const stdString &channel_name,
+                      const epicsTime &start, const epicsTime &end,
+                      ReaderFactory::How how = ReaderFactory::Raw, double delta = 0.0,
+                      size_t max_samples = 0);
+
+    /*
+        Appends the next at most max_samples samples of the cursor to samples.
+        Returns false if there are no more samples to read.
+        Throws GenericException on error or if the archive is closed.
+    */
+    bool readCursor(size_t cursor, size_t max_samples, ChannelSamples &samples);
+
+    /*
+        Closes the cursor. Closing the archive closes all its cursors.
+    */
+    void closeCursor(size_t cursor);
+
+private:
+    PROHIBIT_DEFAULT_COPY(Archive);
+
+    stdString index_name;
+
+    // only used by the archive thread
+    IndexFile index;
+    ScannedIndex scanned; // index with the entries of the last readMatchingChannels
+    struct Reader;
+    std::map<stdString, Reader *> readers; // at most max_readers
+    unsigned long reader_uses; // counts getReader calls, orders the readers by last use
+    struct Cursor;
+    std::map<size_t, Cursor *> cursors;
+    size_t next_cursor;
+
+    DataReader &getReader(const stdString &channel_name, ReaderFactory::How how, double delta);
+
+    // runs task in the archive thread and rethrows its exception,
+    // polls control while waiting for it
+    void run(const std::function<void ()> &task, QueryControl *control = 0);
+    void threadMain();
+
+    std::mutex call_mutex; // one caller at a time
+    mutable std::mutex mutex; // protects the fields below
+    std::condition_variable cond;
+    const std::function<void ()> *task;
+    std::exception_ptr error;
+    bool done;
+    bool quit;
+    bool open;
+    std::thread thread;
+};
+
+#endif
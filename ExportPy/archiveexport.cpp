@@ -4,12 +4,21 @@
 #include <Python.h>
 #include <datetime.h>
 
+// C, C++
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
 // Tools
 #include <AutoPtr.h>
 #include <ArgParser.h>
 #include <BinaryTree.h>
 #include <RegularExpression.h>
 #include <epicsTimeHelper.h>
+#include <FileReader.h>
 
 
 // Storage
@@ -22,8 +31,105 @@
 #include <epicsVersion.h>
 
 
+#include "archive.h"
+#include "arrow.h"
+#include "pool.h"
+#include "query.h"
+#include "shm.h"
 #include "utils.h"
 
+/* Free-threaded builds lock objects in critical sections, the GIL does it elsewhere */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+/*
+    State of one module instance, so the module can be loaded in several
+    (sub)interpreters, see archiveexport_exec. The module state is zeroed
+    memory, all members are plain pointers.
+*/
+typedef struct {
+    PyTypeObject *archive_type;
+    PyTypeObject *arrow_batch_type;
+    PyTypeObject *data_iterator_type;
+    ResultKeys keys;
+} ModuleState;
+
+#if PY_VERSION_HEX < 0x03090000
+/* Before Python 3.9 types cannot find their module, so there is only one */
+static PyObject *single_module = NULL;
+#endif
+
+static ModuleState *
+ModuleState_Get(PyObject *module)
+{
+    return (ModuleState *) PyModule_GetState(module);
+}
+
+/*
+    Returns the state of the module that created type, one of the types in ModuleState.
+*/
+static ModuleState *
+ModuleState_FromType(PyTypeObject *type)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    return (ModuleState *) PyType_GetModuleState(type);
+#else
+    return ModuleState_Get(single_module);
+#endif
+}
+
+/*
+    Lists channel names matching pattern, from the archive if it is given,
+    else from the index opened by name. Returns PyList of channel names.
+*/
+static PyObject *
+listChannelNames(Archive *archive, const char *index_name, const char *pattern)
+{
+    // scan the index without holding the GIL
+    std::vector<stdString> channel_names;
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        if (archive){
+            archive->listChannels(pattern ? pattern : "", channel_names);
+        }else{
+            listChannels(index_name, pattern ? pattern : "", channel_names);
+        }
+    }catch (std::exception &e){
+        failed = true;
+        // guessing that file was not found
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *list;
+
+    if(!(list = PyList_New(0))) {
+        PyErr_SetString(PyExc_RuntimeError, "List could not be created.");
+        return NULL;
+    }
+
+    try{
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            PyList_AppendDECREF(list, PyUnicode_FromString(channel_names[i].c_str()));
+        }
+    }catch (std::exception &e){
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_DECREF(list);
+        return NULL;
+    }
+
+    return list;
+}
+
 /*
     Callable from python: archiverexport.list()
     Arguments:
@@ -45,272 +151,2852 @@ archiveexport_list(PyObject *self, PyObject *args, PyObject *keywds)
         return NULL;
     }
 
-    PyObject *list;
+    return listChannelNames(NULL, index_name, pattern);
+}
 
-    if(!(list = PyList_New(0))) {
-        PyErr_SetString(PyExc_RuntimeError, "List could not be created.");
+/*
+    Catalogs the channels matching pattern from the archive if it is given, else
+    from the index opened by name with threads worker threads, see catalogChannel.
+    Returns dict of dicts {"channel_name": {"first": datetime, "last": datetime, ...}, ...}
+*/
+static PyObject *
+catalogChannelNames(const ResultKeys &keys, Archive *archive, const char *index_name, const char *pattern,
+                    int threads)
+{
+    if (threads < 1){
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1.");
         return NULL;
     }
-    
-    /* open index file in readonly mode */ 
-    IndexFile index;
+
+    // walk the index without holding the GIL
+    std::vector<stdString> names;
+    std::vector<ChannelCatalog> catalogs;
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
     try{
-        index.open(index_name, true);
-    }catch (GenericException &e){
-        // guessing that file was not found
-        PyErr_SetString(PyExc_RuntimeError, e.what());
-        return NULL;
+        if (archive){
+            archive->catalogChannels(pattern ? pattern : "", names, catalogs);
+        }else{
+            catalogChannels(index_name, pattern ? pattern : "", names, catalogs, threads);
+        }
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
     }
+    Py_END_ALLOW_THREADS
 
-    try
-    {
-        AutoPtr<RegularExpression> regex;        
-        if (pattern && strlen(pattern)  > 0) {
-            regex.assign(new RegularExpression(pattern));
-        }
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
 
-        Index::NameIterator name_iter;
-        if (!index.getFirstChannel(name_iter)) {
-            // no names found, return an empty list.
-            return list;
+    PyObject *container_dict;
+    if(!(container_dict = PyDict_New())){
+        return NULL;
+    }
+    try{
+        for (size_t i = 0; i < names.size(); ++i){
+            const ChannelCatalog &catalog = catalogs[i];
+            PyObject *channel_name;
+            if(!(channel_name = PyUnicode_FromString(names[i].c_str()))){
+                throw std::runtime_error("Channel name could not be created.");
+            }
+            PyObject *catalog_dict = PyDict_New();
+            PyDict_SetItemDECREF(container_dict, channel_name, catalog_dict);
+            if (catalog.valid){
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_FIRST], PyDateTime_FromEpicsTime(catalog.first));
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_LAST], PyDateTime_FromEpicsTime(catalog.last));
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_TYPE], PyLong_FromLong(catalog.type));
+            }else{
+                Py_INCREF(Py_None);
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_FIRST], Py_None);
+                Py_INCREF(Py_None);
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_LAST], Py_None);
+                Py_INCREF(Py_None);
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_TYPE], Py_None);
+            }
+            const char *dtype = catalog.valid ? NumpyDtype_FromDBRType(catalog.type) : NULL;
+            if (dtype){
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_DTYPE], PyUnicode_FromString(dtype));
+            }else{
+                Py_INCREF(Py_None);
+                PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_DTYPE], Py_None);
+            }
+            PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_COUNT], PyLong_FromLong(catalog.count));
+            PyDict_SetItemDECREFItem(catalog_dict, keys[KEY_SAMPLES], PyLong_FromSize_t(catalog.samples));
         }
-        do
-        {
-            if (regex && !regex->doesMatch(name_iter.getName()))
-                continue; // skip what doesn't match the regex
-            // otherwise append it to the list
-            PyList_AppendDECREF(list, PyUnicode_FromString(name_iter.getName().c_str()));
+    }catch (std::exception &e){
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
         }
-        while (index.getNextChannel(name_iter));
-        // NC: getFirstChannel and getNextChannel is a pretty insane interface you have to deal with...
-    }
-    catch (GenericException &e)
-    {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_DECREF(container_dict);
         return NULL;
     }
-
-    return list;
+    return container_dict;
 }
+
 /*
-    Callable from python: archiverexport.get_data()
+    Callable from python: archiverexport.catalog()
     Arguments:
         index_name            ... path to the index file
-        channels              ... list of channel names
-        start (optional)      ... start time (python datetime)
-        stop                  ... end time (python datetime)
-        get_units             ... get information about engineering units
-        get_status            ... get information about status and severity  
-        get_info              ... get high low, alarm, warning and display limits or enum string
+        pattern (optional)    ... regex pattern for channel names
+        threads (optional)    ... number of threads reading the data block headers (default 1)
 
-    Returns Dict of Lists of dicts:
+    Returns Dict of dicts, one per channel matching pattern in the order of list(),
+    read from the index and the headers of the first and last data block only:
         {
-            "channel_name1": 
-                [
-                    {"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}
-                    {"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}
-                    ...
-                ],
-            "channel_name2":[...],
+            "channel_name1": {"first": datetime, "last": datetime, "type": type, "dtype": dtype,
+                              "count": count, "samples": samples},
             ...
         }
-    If possible it allways returns one data point before start and one after stop and 
-    everything in between.
+    "first" and "last" are the time range of the channel as naive local datetimes,
+    "type" and "count" the DBR type and array size of the last data block, "dtype"
+    the matching numpy dtype (see NumpyDtype_FromDBRType) and "samples" an estimate
+    of the number of samples, see catalogChannel. A channel without data blocks has
+    None times and types and a count of 0.
 */
 static PyObject *
-archiveexport_get_data(PyObject *self, PyObject *args, PyObject *keywds)
+archiveexport_catalog(PyObject *self, PyObject *args, PyObject *keywds)
 {
-
     char *index_name = NULL;
-    PyObject *channel_names = NULL;
-    PyObject *channel_name = NULL;
-    // NC: Store start and end in this scope instead of on the heap.
-    epicsTime start;
-    epicsTime end;
-    int get_units  = false;
-    int get_status = false;
-    int get_info   = false;
-    
-    Py_ssize_t n;
+    char *pattern = NULL;
+    int threads = 1;
 
-    char *kwlist[] = {  (char *)"index_name", 
-                        (char *)"channels", 
-                        (char *)"start", 
-                        (char *)"end",
-                        (char *)"get_units", 
-                        (char *)"get_status",
-                        (char *)"get_info",
-                        NULL
-                    };
+    char *kwlist[] = {(char *)"index_name", (char *)"pattern", (char *)"threads", NULL};
 
-    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$O!O&O&ppp", kwlist, 
-                                        &index_name, 
-                                        &PyList_Type, &channel_names,
-                                        EpicsTime_FromPyDateTimeConverter, (void*) &start, 
-                                        EpicsTime_FromPyDateTimeConverter, (void*) &end,
-                                        &get_units,
-                                        &get_status,
-                                        &get_info                                        
-                                     ) 
-        )
-    {
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$si", kwlist, &index_name, &pattern, &threads)){
         return NULL;
     }
-        
-    n = PyList_Size(channel_names);
 
-    // check channel names for type
-    for (int i = 0; i < n; i++){
-        if(!(channel_name = PyList_GetItem(channel_names, i))){
-            return NULL; // PyExc is set by PyList_GetItem
-        }
-        if(!PyUnicode_Check(channel_name)){
-            PyErr_SetString(PyExc_TypeError, "Channel names must be strings.");
-            return NULL;
-        }
-    }
+    return catalogChannelNames(ModuleState_Get(self)->keys, NULL, index_name, pattern, threads);
+}
+
+/*
+    Python object of an ArrowBatch, see arrow.h. It implements the Arrow PyCapsule
+    interface, so pyarrow.record_batch(), pyarrow.table(), polars and other Arrow
+    consumers import it without copying. No arrow library is needed for that.
+*/
+typedef struct {
+    PyObject_HEAD
+    ArrowBatch *batch;
+} ArrowBatchObject;
 
-    /* open index file in readonly mode */ 
-    IndexFile index;
+/*
+    Creates an ArrowBatchObject of type for segment s of samples, or an empty double batch
+    if samples has no segments. Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+ArrowBatch_FromChannelSamples(PyTypeObject *type, const ChannelSamples &samples, size_t s)
+{
+    ArrowBatchObject *self;
+    if (!(self = PyObject_New(ArrowBatchObject, type))){
+        return NULL;
+    }
     try{
-        index.open(index_name, true);
-    }catch (GenericException &e){
+        self->batch = s < samples.segments.size() ? new ArrowBatch(samples, s)
+                                                  : new ArrowBatch(DBR_TIME_DOUBLE, 1);
+    }catch (std::exception &e){
+        self->batch = NULL;
+        Py_DECREF(self);
         PyErr_SetString(PyExc_RuntimeError, e.what());
         return NULL;
     }
-    
-    AutoPtr<DataReader> reader(ReaderFactory::create(index, ReaderFactory::Raw, 0.0));
+    return (PyObject *) self;
+}
 
-    // top container dict
-    PyObject *container_dict;
-    if(!(container_dict = PyDict_New())){
-        PyErr_SetString(PyExc_RuntimeError, "Dict could not be created.");
-        return NULL;
+static void
+ArrowBatch_dealloc(ArrowBatchObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete self->batch;
+    type->tp_free((PyObject *) self);
+#if PY_VERSION_HEX >= 0x03080000
+    Py_DECREF(type); // instances of heap types own a reference to their type
+#endif
+}
+
+/* Capsule destructors release the struct unless the consumer moved it out */
+static void
+ArrowSchema_CapsuleDestructor(PyObject *capsule)
+{
+    ArrowSchema *schema = (ArrowSchema *) PyCapsule_GetPointer(capsule, "arrow_schema");
+    if (schema && schema->release){
+        schema->release(schema);
+    }
+    delete schema;
+}
+
+static void
+ArrowArray_CapsuleDestructor(PyObject *capsule)
+{
+    ArrowArray *array = (ArrowArray *) PyCapsule_GetPointer(capsule, "arrow_array");
+    if (array && array->release){
+        array->release(array);
+    }
+    delete array;
+}
+
+static void
+ArrowArrayStream_CapsuleDestructor(PyObject *capsule)
+{
+    ArrowArrayStream *stream = (ArrowArrayStream *) PyCapsule_GetPointer(capsule, "arrow_array_stream");
+    if (stream && stream->release){
+        stream->release(stream);
+    }
+    delete stream;
+}
+
+static PyObject *
+PyCapsule_FromArrowSchema(const ArrowBatch &batch)
+{
+    ArrowSchema *schema = new (std::nothrow) ArrowSchema();
+    if (!schema){
+        return PyErr_NoMemory();
     }
-    
     try{
-        // for each channel name
-        for (int i = 0; i < n; i++){
-            if(!(channel_name = PyList_GetItem(channel_names, i))){
-                return NULL; // PyExc is set by PyList_GetItem
-            }
-            
-            // create first channel list
-            PyObject *value_list; 
-            if(!(value_list = PyList_New(0))) {
-                PyErr_SetString(PyExc_RuntimeError, "List could not be created.");
-                return NULL;
-            }
+        batch.exportSchema(schema);
+    }catch (std::exception &e){
+        delete schema;
+        return PyErr_NoMemory();
+    }
+    PyObject *capsule;
+    if (!(capsule = PyCapsule_New(schema, "arrow_schema", ArrowSchema_CapsuleDestructor))){
+        schema->release(schema);
+        delete schema;
+    }
+    return capsule;
+}
 
-            // find first value
-            const RawValue::Data *value;
-            try{    
-                value = reader->find(PyUnicode_AsUTF8(channel_name), &start);
-            }catch (GenericException &e){
-                PyErr_SetString(PyExc_RuntimeError, e.what());
-                return NULL;
-            }
-            while (value)
-            {
-                if (! RawValue::isInfo(value)){ // true here indicates a special record marking interruption in data recording
-                    // create a placeholder for the value
-                    PyObject *row_dict;
-
-                    if(!(row_dict = PyDict_New())){
-                        PyErr_SetString(PyExc_RuntimeError, "row_dict could not be created.");
-                        return NULL;
-                    }
-
-                    //timestamp
-                    epicsTime timestamp = RawValue::getTime(value);
-
-                    try{
-                        // value 
-                        PyDict_SetItemStringDECREF(row_dict, "value", PyObject_FromDBRType(value, reader->getType(), reader->getCount()));
-                        // sec 
-                        PyDict_SetItemStringDECREF(row_dict, "seconds", PyLong_FromLong(epicsTimeStamp(timestamp).secPastEpoch)); 
-                        // nsec 
-                        PyDict_SetItemStringDECREF(row_dict, "nanoseconds", PyLong_FromLong(epicsTimeStamp(timestamp).nsec));
-                        // units  - surrogateescape does not fail on undecodable characters
-                        if(get_units && reader->getInfo().getType()==CtrlInfo::Numeric){
-                            PyDict_SetItemStringDECREF(row_dict, "unit", PyUnicode_Surrogateescape(reader->getInfo().getUnits()));
-                        }
-                        // status & severity
-                        if(get_status){
-                            PyDict_SetItemStringDECREF(row_dict, "status", PyLong_FromLong(value->status));
-                            PyDict_SetItemStringDECREF(row_dict, "status_string", PyObyect_getStatusString(value));
-                            PyDict_SetItemStringDECREF(row_dict, "severity", PyLong_FromLong(value->severity));
-                            PyDict_SetItemStringDECREF(row_dict, "severity_string", PyObyect_getSeverityString(value));
-                        }
-                        // info
-                        if(get_info){
-                            if(reader->getInfo().getType()==CtrlInfo::Numeric){
-                                // all limit values are achived as floats
-                                PyDict_SetItemStringDECREF(row_dict, "low_alarm", PyFloat_FromDouble(reader->getInfo().getLowAlarm()));
-                                PyDict_SetItemStringDECREF(row_dict, "low_warn", PyFloat_FromDouble(reader->getInfo().getLowWarning()));
-                                PyDict_SetItemStringDECREF(row_dict, "high_warn", PyFloat_FromDouble(reader->getInfo().getHighAlarm()));
-                                PyDict_SetItemStringDECREF(row_dict, "high_alarm", PyFloat_FromDouble(reader->getInfo().getHighWarning()));
-                                PyDict_SetItemStringDECREF(row_dict, "disp_low", PyFloat_FromDouble(reader->getInfo().getDisplayLow()));
-                                PyDict_SetItemStringDECREF(row_dict, "disp_high", PyFloat_FromDouble(reader->getInfo().getDisplayHigh()));
-                                PyDict_SetItemStringDECREF(row_dict, "precision", PyLong_FromLong(reader->getInfo().getPrecision()));
-                            }
-                            if(reader->getType()==DBR_TIME_ENUM) {
-                                PyDict_SetItemStringDECREF(row_dict, "enum_string", PyObyect_getEnumString(value, reader->getInfo()));
-                            }
-                        }
-                    }
-                    catch(std::exception &e){
-                        Py_DECREF(row_dict);
-                        throw e;
-                    }
-                    // append dict to the list 
-                    PyList_AppendDECREF(value_list, row_dict);
-
-
-                    // break one node after the end timestamp if end was set (is greater than 0) 
-                    if (end > epicsTime() && timestamp >= end)
-                        break;
-                }
-                // next value
-                value = reader->next();
-            }
+static PyObject *
+PyCapsule_FromArrowArray(const ArrowBatch &batch)
+{
+    ArrowArray *array = new (std::nothrow) ArrowArray();
+    if (!array){
+        return PyErr_NoMemory();
+    }
+    try{
+        batch.exportArray(array);
+    }catch (std::exception &e){
+        delete array;
+        return PyErr_NoMemory();
+    }
+    PyObject *capsule;
+    if (!(capsule = PyCapsule_New(array, "arrow_array", ArrowArray_CapsuleDestructor))){
+        array->release(array);
+        delete array;
+    }
+    return capsule;
+}
 
-            // add values list to the dictionary, dispose item only, since key is still used in channel_names
-            PyDict_SetItemDECREFItem(container_dict, channel_name, value_list);
+/*
+    The batch has a fixed schema, a requested_schema is ignored as allowed by
+    the PyCapsule interface, the consumer casts if needed.
+*/
+static bool
+ArrowBatch_parseRequestedSchema(PyObject *args, PyObject *keywds)
+{
+    PyObject *requested_schema = NULL;
+    char *kwlist[] = {(char *)"requested_schema", NULL};
+    return PyArg_ParseTupleAndKeywords(args, keywds, "|O", kwlist, &requested_schema);
+}
 
-        }
-    }catch(std::exception &e){
-        PyErr_SetString(PyExc_RuntimeError, e.what());
-        Py_DECREF(container_dict);
+static PyObject *
+ArrowBatch_arrow_c_schema(ArrowBatchObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return PyCapsule_FromArrowSchema(*self->batch);
+}
+
+static PyObject *
+ArrowBatch_arrow_c_array(ArrowBatchObject *self, PyObject *args, PyObject *keywds)
+{
+    if (!ArrowBatch_parseRequestedSchema(args, keywds)){
+        return NULL;
+    }
+    PyObject *schema, *array;
+    if (!(schema = PyCapsule_FromArrowSchema(*self->batch))){
+        return NULL;
+    }
+    if (!(array = PyCapsule_FromArrowArray(*self->batch))){
+        Py_DECREF(schema);
         return NULL;
     }
+    PyObject *tuple = PyTuple_Pack(2, schema, array);
+    Py_DECREF(schema);
+    Py_DECREF(array);
+    return tuple;
+}
 
-    return container_dict;
+static PyObject *
+ArrowBatch_arrow_c_stream(ArrowBatchObject *self, PyObject *args, PyObject *keywds)
+{
+    if (!ArrowBatch_parseRequestedSchema(args, keywds)){
+        return NULL;
+    }
+    ArrowArrayStream *stream = new (std::nothrow) ArrowArrayStream();
+    if (!stream){
+        return PyErr_NoMemory();
+    }
+    try{
+        self->batch->exportStream(stream);
+    }catch (std::exception &e){
+        delete stream;
+        return PyErr_NoMemory();
+    }
+    PyObject *capsule;
+    if (!(capsule = PyCapsule_New(stream, "arrow_array_stream", ArrowArrayStream_CapsuleDestructor))){
+        stream->release(stream);
+        delete stream;
+    }
+    return capsule;
 }
 
-/* Export to Python */
+static Py_ssize_t
+ArrowBatch_length(ArrowBatchObject *self)
+{
+    return self->batch->size();
+}
 
-static PyMethodDef ArchiveExportMethods[] = {
-    {"list",   (PyCFunction)archiveexport_list, METH_VARARGS|METH_KEYWORDS, "Find channels."},
-    {"get_data",   (PyCFunction)archiveexport_get_data, METH_VARARGS|METH_KEYWORDS, "Get data."},
+static PyMethodDef ArrowBatchMethods[] = {
+    {"__arrow_c_schema__", (PyCFunction)ArrowBatch_arrow_c_schema, METH_NOARGS, "Export the schema as a PyCapsule."},
+    {"__arrow_c_array__",  (PyCFunction)ArrowBatch_arrow_c_array, METH_VARARGS|METH_KEYWORDS, "Export schema and array as PyCapsules."},
+    {"__arrow_c_stream__", (PyCFunction)ArrowBatch_arrow_c_stream, METH_VARARGS|METH_KEYWORDS, "Export a stream of this batch as a PyCapsule."},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
-PyDoc_STRVAR(archiveexport_doc, "This module can extract data from ChannelArchiver files.");
+PyDoc_STRVAR(arrow_batch_doc, "Samples of one channel as an Arrow record batch.");
+
+static PyType_Slot ArrowBatchSlots[] = {
+    {Py_tp_dealloc, (void *)ArrowBatch_dealloc},
+    {Py_tp_methods, (void *)ArrowBatchMethods},
+    {Py_sq_length,  (void *)ArrowBatch_length},
+    {Py_tp_doc,     (void *)arrow_batch_doc},
+    {0, NULL}
+};
+
+static PyType_Spec ArrowBatchSpec = {
+    "archiveexport.ArrowBatch",
+    sizeof(ArrowBatchObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    ArrowBatchSlots
+};
+
+/*
+    Converts the samples of a channel to one ArrowBatch, or a list of ArrowBatch
+    with one batch per segment if the type or count of the channel changed.
+    Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+PyObject_ArrowFromChannelSamples(PyTypeObject *type, const ChannelSamples &samples)
+{
+    if (samples.segments.size() <= 1){
+        return ArrowBatch_FromChannelSamples(type, samples, 0);
+    }
+
+    PyObject *list;
+    if (!(list = PyList_New(samples.segments.size()))){
+        return NULL;
+    }
+    for (size_t s = 0; s < samples.segments.size(); ++s){
+        PyObject *batch;
+        if (!(batch = ArrowBatch_FromChannelSamples(type, samples, s))){
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SetItem(list, s, batch);
+    }
+    return list;
+}
+
+/*
+    How the samples of a channel are converted to python objects,
+    from the arguments of get_data() and iter_data().
+*/
+struct OutputFormat
+{
+    bool get_units;
+    bool get_status;
+    bool get_info;
+    bool info_segments;     // layout="segments"
+    bool arrow;             // output="arrow"
+    bool shm;               // output="shm"
+    TimestampFormat timestamps;
+    PyObject *numpy_empty;  // output="numpy", see Numpy_GetEmpty
+    ModuleState *state;     // result keys and ArrowBatch type
+};
+
+/*
+    Checks the output, layout and timestamps arguments and fills format. For output="numpy"
+    numpy is imported, the caller releases format.numpy_empty.
+    timestamps is "epics" (default), "ns" or "datetime64", see TimestampFormat.
+    output="arrow" always has a timestamp column and ignores it.
+    Sets PyExc and returns false on failure.
+*/
+static bool
+parseOutputFormat(OutputFormat &format, ModuleState *state, int get_units, int get_status, int get_info,
+                  const char *output, const char *layout, const char *timestamps)
+{
+    format.state = state;
+    format.get_units = get_units;
+    format.get_status = get_status;
+    format.get_info = get_info;
+    format.info_segments = false;
+    format.arrow = false;
+    format.shm = false;
+    format.timestamps = TIMESTAMPS_EPICS;
+    format.numpy_empty = NULL;
+
+    bool output_numpy = false;
+    if (output && strcmp(output, "numpy") == 0){
+        output_numpy = true;
+    }else if (output && strcmp(output, "arrow") == 0){
+        format.arrow = true;
+    }else if (output && strcmp(output, "shm") == 0){
+        format.shm = true;
+    }else if (output && strcmp(output, "dict") != 0){
+        PyErr_SetString(PyExc_ValueError, "output must be \"dict\", \"numpy\", \"arrow\" or \"shm\".");
+        return false;
+    }
+    if (layout && strcmp(layout, "segments") == 0){
+        format.info_segments = true;
+    }else if (layout && strcmp(layout, "rows") != 0){
+        PyErr_SetString(PyExc_ValueError, "layout must be \"rows\" or \"segments\".");
+        return false;
+    }
+    if ((output_numpy || format.arrow || format.shm) && format.info_segments){
+        PyErr_SetString(PyExc_ValueError, "layout=\"segments\" requires output=\"dict\".");
+        return false;
+    }
+    if (timestamps && strcmp(timestamps, "ns") == 0){
+        format.timestamps = TIMESTAMPS_NS;
+    }else if (timestamps && strcmp(timestamps, "datetime64") == 0){
+        format.timestamps = TIMESTAMPS_DATETIME64;
+    }else if (timestamps && strcmp(timestamps, "epics") != 0){
+        PyErr_SetString(PyExc_ValueError, "timestamps must be \"epics\", \"ns\" or \"datetime64\".");
+        return false;
+    }
+    if (format.timestamps == TIMESTAMPS_DATETIME64 && !(output_numpy || format.arrow || format.shm)){
+        PyErr_SetString(PyExc_ValueError, "timestamps=\"datetime64\" requires output=\"numpy\", \"arrow\" or \"shm\".");
+        return false;
+    }
+
+    if (output_numpy && !(format.numpy_empty = Numpy_GetEmpty())){
+        return false; // PyExc is set by Numpy_GetEmpty
+    }
+    return true;
+}
+
+/*
+    Checks the how and delta arguments and sets reader_how, see ReaderFactory.
+    how is "raw" (default), "plotbin", "average" or "linear", the binning readers
+    need delta > 0 seconds.
+    Sets PyExc and returns false on failure.
+*/
+static bool
+parseReaderHow(ReaderFactory::How &reader_how, const char *how, double delta)
+{
+    if (!how || strcmp(how, "raw") == 0){
+        reader_how = ReaderFactory::Raw;
+        return true;
+    }
+    if (strcmp(how, "plotbin") == 0){
+        reader_how = ReaderFactory::Plotbin;
+    }else if (strcmp(how, "average") == 0){
+        reader_how = ReaderFactory::Average;
+    }else if (strcmp(how, "linear") == 0){
+        reader_how = ReaderFactory::Linear;
+    }else{
+        PyErr_SetString(PyExc_ValueError, "how must be \"raw\", \"plotbin\", \"average\" or \"linear\".");
+        return false;
+    }
+    if (!(delta > 0.0)){
+        PyErr_Format(PyExc_ValueError, "how=\"%s\" requires delta > 0 seconds.", how);
+        return false;
+    }
+    return true;
+}
+
+/*
+    Converts the samples of a channel as selected by format.
+    Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+PyObject_FromChannel(const ChannelSamples &samples, const OutputFormat &format)
+{
+    const ResultKeys &keys = format.state->keys;
+    if (format.arrow){
+        return PyObject_ArrowFromChannelSamples(format.state->arrow_batch_type, samples);
+    }
+    if (format.numpy_empty){
+        return PyObject_FromChannelSamples(samples, format.numpy_empty, format.get_units, format.get_info,
+                                           format.timestamps, keys);
+    }
+    if (format.info_segments){
+        return PyDict_FromChannelSamples(samples, format.get_units, format.get_status, format.get_info,
+                                         format.timestamps, keys);
+    }
+    return PyList_FromChannelSamples(samples, format.get_units, format.get_status, format.get_info,
+                                     format.timestamps, keys);
+}
+
+/*
+    Creates the descriptor of a query written to shared memory, see writeSharedMemory:
+        {
+            "name": name,
+            "size": size,
+            "channels": {"channel_name1": {"value": {"offset": offset, "dtype": dtype, "shape": shape}, ...}, ...}
+        }
+    Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+PyDict_FromShmResult(const std::vector<stdString> &names, const std::vector<ChannelSamples> &samples,
+                     const ShmResult &shm, const OutputFormat &format)
+{
+    const ResultKeys &keys = format.state->keys;
+    PyObject *descriptor, *channels;
+    if (!(descriptor = PyDict_New())){
+        return NULL;
+    }
+    try{
+        PyDict_SetItemDECREFItem(descriptor, keys[KEY_NAME], PyUnicode_FromString(shm.name.c_str()));
+        PyDict_SetItemDECREFItem(descriptor, keys[KEY_SIZE], PyLong_FromSize_t(shm.size));
+        if (!(channels = PyDict_New())){
+            throw std::runtime_error("Dict could not be created.");
+        }
+        PyDict_SetItemDECREFItem(descriptor, keys[KEY_CHANNELS], channels);
+        for (size_t i = 0; i < names.size(); i++){
+            PyObject *channel_name;
+            if (!(channel_name = PyUnicode_FromString(names[i].c_str()))){
+                throw std::runtime_error("Channel name could not be created.");
+            }
+            PyDict_SetItemDECREF(channels, channel_name,
+                                 PyObject_FromShmSegments(samples[i], shm.channels[i],
+                                                          format.get_units, format.get_info, format.timestamps, keys));
+        }
+    }catch (std::exception &e){
+        if (!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        Py_DECREF(descriptor);
+        return NULL;
+    }
+    return descriptor;
+}
+
+/*
+    Checks channel names for type and copies them for use without the GIL.
+    channel_names may be NULL for no channels. The results are keyed by the
+    copies, other threads may change the list while the channels are read.
+    Sets PyExc and returns false on failure.
+*/
+static bool
+parseChannelNames(PyObject *channel_names, std::vector<stdString> &names)
+{
+    if (!channel_names){
+        return true;
+    }
+    // the slice owns its items, PyList_GetItem of a shared list would not
+    PyObject *list;
+    if (!(list = PyList_GetSlice(channel_names, 0, PY_SSIZE_T_MAX))){
+        return false;
+    }
+    Py_ssize_t n = PyList_Size(list);
+
+    PyObject *channel_name;
+    for (int i = 0; i < n; i++){
+        channel_name = PyList_GetItem(list, i);
+        if(!PyUnicode_Check(channel_name)){
+            PyErr_SetString(PyExc_TypeError, "Channel names must be strings.");
+            Py_DECREF(list);
+            return false;
+        }
+        const char *name;
+        if(!(name = PyUnicode_AsUTF8(channel_name))){
+            Py_DECREF(list);
+            return false; // PyExc is set by PyUnicode_AsUTF8
+        }
+        names.push_back(name);
+    }
+    Py_DECREF(list);
+    return true;
+}
+
+/*
+    Native arguments and results of get_data(), so the channels can be read
+    without the GIL, by the calling thread or by the async pool.
+*/
+struct DataQuery
+{
+    DataQuery() : archive(0), has_pattern(false), how(ReaderFactory::Raw), delta(0.0),
+                  threads(1), max_samples(0), shm_output(false), shm_unix_time(false), control(0)
+    {}
+
+    Archive *archive;              // or index_name
+    stdString index_name;
+    std::vector<stdString> names;  // channels, or the ones matching pattern after run
+    bool has_pattern;
+    stdString pattern;
+    epicsTime start;
+    epicsTime end;
+    ReaderFactory::How how;
+    double delta;
+    size_t threads;
+    size_t max_samples;
+    bool shm_output;               // output="shm"
+    bool shm_unix_time;            // with timestamps="ns" or "datetime64"
+    QueryControl *control;
+
+    std::vector<ChannelSamples> samples;
+    ShmResult shm;
+
+    /*
+        Reads all channels, and writes them to shared memory for output="shm".
+        Throws GenericException on error.
+    */
+    void run();
+};
+
+void DataQuery::run()
+{
+    if (archive && has_pattern){
+        archive->readMatchingChannels(pattern, start, end, names, samples, how, delta, max_samples, control);
+    }else if (archive){
+        archive->readChannels(names, start, end, samples, how, delta, max_samples, control);
+    }else if (has_pattern){
+        readMatchingChannels(index_name, pattern, start, end, names, samples, how, delta, threads, max_samples,
+                             control);
+    }else{
+        readChannels(index_name, names, start, end, samples, how, delta, threads, max_samples, control);
+    }
+    if (shm_output){
+        writeSharedMemory(samples, shm, shm_unix_time);
+    }
+}
+
+/*
+    QueryControl of get_data(), polled by the calling thread while the channels
+    are read without the GIL: it takes the GIL back to check for signals (Ctrl-C),
+    to ask the cancel token and to call the progress callback every progress_every
+    samples. The first exception raised by any of them stops the query, get_data()
+    raises it instead of returning the result.
+*/
+class PyQueryControl : public QueryControl
+{
+public:
+    /* progress and cancel are borrowed, either may be NULL */
+    PyQueryControl(PyObject *progress, size_t progress_every, PyObject *cancel)
+        : progress(progress), progress_every(progress_every), cancel(cancel), reported(0),
+          thread_state(NULL), error_type(NULL), error_value(NULL), error_traceback(NULL)
+    {}
+
+    /* Needs the GIL */
+    ~PyQueryControl()
+    {
+        Py_XDECREF(error_type);
+        Py_XDECREF(error_value);
+        Py_XDECREF(error_traceback);
+    }
+
+    /* Like Py_BEGIN_ALLOW_THREADS, the query runs in between */
+    void releaseGIL() { thread_state = PyEval_SaveThread(); }
+
+    /* Like Py_END_ALLOW_THREADS */
+    void acquireGIL() { PyEval_RestoreThread(thread_state); }
+
+    void poll();
+
+    /* Same as poll(), for the thread holding the GIL */
+    void pollHoldingGIL();
+
+    /*
+        Sets PyExc to the exception that stopped the query.
+        Returns false if the query was not stopped by one.
+    */
+    bool raiseError();
+
+private:
+    /* Returns false with PyExc set on failure */
+    bool pollCancel();
+    bool pollProgress();
+
+    PyObject *progress;
+    size_t progress_every;
+    PyObject *cancel;
+    size_t reported; // samples read when progress was last called
+    PyThreadState *thread_state;
+    PyObject *error_type, *error_value, *error_traceback;
+};
+
+void PyQueryControl::poll()
+{
+    acquireGIL();
+    pollHoldingGIL();
+    releaseGIL();
+}
+
+void PyQueryControl::pollHoldingGIL()
+{
+    if (!error_type && (PyErr_CheckSignals() < 0 || !pollCancel() || !pollProgress())){
+        PyErr_Fetch(&error_type, &error_value, &error_traceback);
+        cancelled = true;
+    }
+}
+
+bool PyQueryControl::pollCancel()
+{
+    if (!cancel){
+        return true;
+    }
+    PyObject *is_set;
+    if (!(is_set = PyObject_CallMethod(cancel, "is_set", NULL))){
+        return false;
+    }
+    int set = PyObject_IsTrue(is_set);
+    Py_DECREF(is_set);
+    if (set < 0){
+        return false;
+    }
+    if (set){
+        cancelled = true; // get_data() fails with "Query cancelled."
+    }
+    return true;
+}
+
+bool PyQueryControl::pollProgress()
+{
+    if (!progress){
+        return true;
+    }
+    stdString channel_name;
+    epicsTime time;
+    size_t samples = getProgress(channel_name, time);
+    if (samples - reported < progress_every){
+        return true;
+    }
+    reported = samples;
+
+    PyObject *result;
+    if (!(result = PyObject_CallFunction(progress, "snN", channel_name.c_str(), (Py_ssize_t) samples,
+                                         PyDateTime_FromEpicsTime(time)))){
+        return false;
+    }
+    Py_DECREF(result);
+    return true;
+}
+
+bool PyQueryControl::raiseError()
+{
+    if (!error_type){
+        return false;
+    }
+    PyErr_Restore(error_type, error_value, error_traceback);
+    error_type = error_value = error_traceback = NULL;
+    return true;
+}
+
+/*
+    Checks progress, progress_every and cancel of get_data(), see PyQueryControl.
+    None counts as not given. Sets PyExc and returns false on failure.
+*/
+static bool
+parseQueryControl(PyObject *&progress, Py_ssize_t progress_every, PyObject *&cancel)
+{
+    if (progress == Py_None){
+        progress = NULL;
+    }
+    if (cancel == Py_None){
+        cancel = NULL;
+    }
+    if (progress && !PyCallable_Check(progress)){
+        PyErr_SetString(PyExc_TypeError, "progress must be callable.");
+        return false;
+    }
+    if (progress_every < 1){
+        PyErr_SetString(PyExc_ValueError, "progress_every must be at least 1.");
+        return false;
+    }
+    if (cancel && !PyObject_HasAttrString(cancel, "is_set")){
+        PyErr_SetString(PyExc_TypeError, "cancel must have an is_set() method, like threading.Event.");
+        return false;
+    }
+    return true;
+}
+
+/*
+    Checks the arguments of get_data() and fills query, see archiveexport_get_data.
+    Reads channel_names, or the channels matching pattern if it is given, from the
+    archive if it is given, else from the index opened by name.
+    Sets PyExc and returns false on failure.
+*/
+static bool
+parseDataQuery(DataQuery &query, Archive *archive, const char *index_name, PyObject *channel_names,
+               const char *pattern, const epicsTime &start, const epicsTime &end,
+               const OutputFormat &format, ReaderFactory::How how, double delta, int threads,
+               Py_ssize_t max_samples)
+{
+    if (threads < 1){
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1.");
+        return false;
+    }
+    if (max_samples < 0){
+        PyErr_SetString(PyExc_ValueError, "max_samples must not be negative.");
+        return false;
+    }
+    if (pattern && channel_names){
+        PyErr_SetString(PyExc_ValueError, "Use either channels or pattern.");
+        return false;
+    }
+    if (!parseChannelNames(channel_names, query.names)){
+        return false;
+    }
+    query.archive = archive;
+    if (index_name){
+        query.index_name = index_name;
+    }
+    query.has_pattern = pattern != NULL;
+    if (pattern){
+        query.pattern = pattern;
+    }
+    query.start = start;
+    query.end = end;
+    query.how = how;
+    query.delta = delta;
+    query.threads = threads;
+    query.max_samples = max_samples;
+    query.shm_output = format.shm;
+    query.shm_unix_time = format.timestamps != TIMESTAMPS_EPICS;
+    return true;
+}
+
+/*
+    Converts the result of a query that ran, see archiveexport_get_data.
+    For output="shm" the object is unlinked if the descriptor cannot be created.
+    Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+PyObject_FromDataQuery(const DataQuery &query, const OutputFormat &format)
+{
+    const std::vector<stdString> &names = query.names;
+    if (format.shm){
+        PyObject *descriptor;
+        if (!(descriptor = PyDict_FromShmResult(names, query.samples, query.shm, format))){
+            unlinkSharedMemory(query.shm.name);
+        }
+        return descriptor;
+    }
+
+    // top container dict
+    PyObject *container_dict;
+    if(!(container_dict = PyDict_New())){
+        PyErr_SetString(PyExc_RuntimeError, "Dict could not be created.");
+        return NULL;
+    }
+    
+    try{
+        // for each channel name
+        for (size_t i = 0; i < names.size(); i++){
+            PyObject *channel_name;
+            if(!(channel_name = PyUnicode_FromString(names[i].c_str()))){
+                throw std::runtime_error("Channel name could not be created.");
+            }
+            PyDict_SetItemDECREF(container_dict, channel_name, PyObject_FromChannel(query.samples[i], format));
+        }
+    }catch(std::exception &e){
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        Py_DECREF(container_dict);
+        return NULL;
+    }
+
+    return container_dict;
+}
+
+/*
+    Reads channel_names, or the channels matching pattern if it is given, from the
+    archive if it is given, else from the index opened by name, see
+    archiveexport_get_data. Arguments are already parsed, except for the
+    ones of the PyQueryControl.
+*/
+static PyObject *
+getData(Archive *archive, const char *index_name, PyObject *channel_names, const char *pattern,
+        const epicsTime &start, const epicsTime &end,
+        const OutputFormat &format, ReaderFactory::How how, double delta, int threads,
+        Py_ssize_t max_samples, PyObject *progress, Py_ssize_t progress_every, PyObject *cancel)
+{
+    DataQuery query;
+    if (!parseDataQuery(query, archive, index_name, channel_names, pattern, start, end,
+                        format, how, delta, threads, max_samples) ||
+        !parseQueryControl(progress, progress_every, cancel)){
+        return NULL;
+    }
+    PyQueryControl control(progress, progress_every, cancel);
+    query.control = &control;
+
+    // a token set before the query cancels it right away
+    control.pollHoldingGIL();
+
+    // read all channels without holding the GIL, control takes it back to poll
+    stdString error;
+    bool failed = false;
+    control.releaseGIL();
+    try{
+        query.run();
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
+    }
+    control.acquireGIL();
+
+    // advance() polls at most every poll_period_ms, report what was read since
+    if (!failed){
+        control.pollHoldingGIL();
+    }
+    if (control.raiseError()){
+        if (!failed && query.shm_output){
+            unlinkSharedMemory(query.shm.name); // stopped after the last sample was read
+        }
+        return NULL;
+    }
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return PyObject_FromDataQuery(query, format);
+}
+
+/*
+    Callable from python: archiverexport.get_data()
+    Arguments:
+        index_name            ... path to the index file
+        channels              ... list of channel names
+        pattern (optional)    ... regex pattern for channel names, instead of channels
+        start (optional)      ... start time (datetime, numpy.datetime64 or seconds since the Unix epoch,
+                                  see EpicsTime_FromPyObjectConverter)
+        stop                  ... end time (same types as start)
+        get_units             ... get information about engineering units
+        get_status            ... get information about status and severity  
+        get_info              ... get high low, alarm, warning and display limits or enum string
+        output (optional)     ... "dict" (default), "numpy", "arrow" or "shm"
+        threads (optional)    ... number of threads reading channels concurrently (default 1)
+        layout (optional)     ... "rows" (default) or "segments"
+        how (optional)        ... "raw" (default), "plotbin", "average" or "linear", see ReaderFactory
+        delta (optional)      ... bin width in seconds for the binning readers
+        max_samples (optional) ... read at most that many samples per channel (default 0, no limit)
+        progress (optional)   ... callable progress(channel, samples, time), see below
+        progress_every (optional) ... samples between progress calls (default 100000)
+        cancel (optional)     ... cancel token with an is_set() method, like threading.Event
+        timestamps (optional) ... "epics" (default), "ns" or "datetime64", see below
+
+    Returns Dict of Lists of dicts:
+        {
+            "channel_name1": 
+                [
+                    {"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}
+                    {"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}
+                    ...
+                ],
+            "channel_name2":[...],
+            ...
+        }
+    If possible it allways returns one data point before start and one after stop and 
+    everything in between.
+    With pattern the result holds every channel matching it, like list() would return
+    them. The matches are read right from the entries found while scanning the names,
+    saving the second name lookup per channel that list() followed by get_data() costs.
+    With max_samples only the first max_samples of these are returned, and the reader
+    stops at the data block holding the last one instead of reading on to stop.
+
+    With output="numpy" every channel maps to a dict of numpy arrays instead,
+    see PyObject_FromChannelSamples:
+        {
+            "channel_name1": {"value": array, "seconds": array, "nanoseconds": array, ...},
+            ...
+        }
+
+    With timestamps="ns" the "seconds" and "nanoseconds" since the Epics epoch are
+    replaced by one "time", nanoseconds since the Unix epoch as int (int64 arrays for
+    numpy and shm). timestamps="datetime64" gives "time" as numpy datetime64[ns] instead,
+    for output="numpy" and "shm". Either way the epoch is shifted natively.
+
+    With output="arrow" every channel maps to an ArrowBatch, see arrow.h, or to a
+    list of ArrowBatch if the type or count of the channel changed. It always has a
+    "timestamp" column, timestamps does not change it.
+
+    With output="shm" the columns of all channels are written to a new POSIX shared
+    memory object and a small descriptor is returned instead, see PyDict_FromShmResult.
+    The consumer maps the object by name and unlinks it when done.
+
+    The status and severity strings of the rows are shared items of the module tuples
+    STATUS_STRINGS and SEVERITY_STRINGS, which also decode the uint16 status and severity
+    arrays of the other outputs. Enum and unit strings are created once per CtrlInfo.
+
+    With layout="segments" units and limits are not repeated in every row, every channel
+    maps to a dict of rows and info segments, see PyDict_FromChannelSamples:
+        {
+            "channel_name1": {"samples": [{"value":value, ..., "info":0}, ...], "info": [{"first":0, "count":count, ...}, ...]},
+            ...
+        }
+
+    The index and data files are read with the GIL released, it is only held
+    again to convert the samples to python objects, and for short polls while the
+    query runs, see PyQueryControl: a pending signal (Ctrl-C) stops the query with
+    KeyboardInterrupt, a set cancel token with RuntimeError "Query cancelled.".
+    Every progress_every samples progress is called with the channel read last,
+    the number of samples read so far (over all channels) and the time of the last
+    sample read, as datetime. An exception raised by progress stops the query and
+    get_data() raises it.
+*/
+static PyObject *
+archiveexport_get_data(PyObject *self, PyObject *args, PyObject *keywds)
+{
+
+    char *index_name = NULL;
+    PyObject *channel_names = NULL;
+    // NC: Store start and end in this scope instead of on the heap.
+    epicsTime start;
+    epicsTime end;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *layout   = NULL;
+    char *how      = NULL;
+    double delta   = 0.0;
+    int threads    = 1;
+    Py_ssize_t max_samples = 0;
+    char *pattern  = NULL;
+    PyObject *progress = NULL;
+    Py_ssize_t progress_every = 100000;
+    PyObject *cancel = NULL;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"index_name", 
+                        (char *)"channels", 
+                        (char *)"start", 
+                        (char *)"end",
+                        (char *)"get_units", 
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"threads",
+                        (char *)"layout",
+                        (char *)"how",
+                        (char *)"delta",
+                        (char *)"max_samples",
+                        (char *)"pattern",
+                        (char *)"progress",
+                        (char *)"progress_every",
+                        (char *)"cancel",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$O!O&O&pppsissdnzOnOz", kwlist, 
+                                        &index_name, 
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start, 
+                                        EpicsTime_FromPyObjectConverter, (void*) &end,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &threads,
+                                        &layout,
+                                        &how,
+                                        &delta,
+                                        &max_samples,
+                                        &pattern,
+                                        &progress,
+                                        &progress_every,
+                                        &cancel,
+                                        &timestamps
+                                     ) 
+        )
+    {
+        return NULL;
+    }
+
+    ReaderFactory::How reader_how;
+    if (!parseReaderHow(reader_how, how, delta)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_Get(self);
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, layout, timestamps)){
+        return NULL;
+    }
+    PyObject *result = getData(NULL, index_name, channel_names, pattern, start, end, format, reader_how, delta, threads, max_samples,
+                               progress, progress_every, cancel);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+/*
+    A get_data() running in the async pool, see archiveexport_get_data_async.
+    The worker thread runs the query without touching the Python API and then
+    writes one byte to the pipe, whose read end is watched by the event loop.
+    The loop converts the result in its own thread and completes the future.
+    Shared by the worker and the AsyncQueryHandle, the last one closes the pipe.
+*/
+struct AsyncQuery
+{
+    AsyncQuery() : finished(false), failed(false) { fds[0] = fds[1] = -1; }
+
+    ~AsyncQuery()
+    {
+        if (fds[0] >= 0)
+            close(fds[0]);
+        if (fds[1] >= 0)
+            close(fds[1]);
+    }
+
+    DataQuery query;
+    QueryControl control;    // cancelled with the future
+    int fds[2];
+    std::atomic<bool> finished; // query, failed and error are set
+    bool failed;
+    stdString error;
+};
+
+/*
+    Python side of an AsyncQuery, owned by the capsule the loop callbacks are bound to.
+*/
+struct AsyncQueryHandle
+{
+    std::shared_ptr<AsyncQuery> async;
+    PyObject *module;  // keeps the module state used by format
+    PyObject *loop;
+    PyObject *future;
+    OutputFormat format;
+};
+
+static const char *async_query_capsule_name = "archiveexport.AsyncQuery";
+
+static void
+AsyncQuery_CapsuleDestructor(PyObject *capsule)
+{
+    AsyncQueryHandle *handle = (AsyncQueryHandle *) PyCapsule_GetPointer(capsule, async_query_capsule_name);
+    Py_XDECREF(handle->module);
+    Py_XDECREF(handle->loop);
+    Py_XDECREF(handle->future);
+    Py_XDECREF(handle->format.numpy_empty);
+    delete handle;
+}
+
+/*
+    Calls method of object with the single argument arg and drops the result.
+    Returns false with PyExc set on failure.
+*/
+static bool
+PyObject_CallMethodDrop(PyObject *object, const char *method, PyObject *arg)
+{
+    PyObject *result = arg ? PyObject_CallMethod(object, method, "(O)", arg)
+                           : PyObject_CallMethod(object, method, NULL);
+    if (!result){
+        return false;
+    }
+    Py_DECREF(result);
+    return true;
+}
+
+/*
+    Called by the loop once the worker wrote to the pipe: completes the future
+    with the result or the exception, unless the future was cancelled meanwhile.
+*/
+static PyObject *
+AsyncQuery_ready(PyObject *capsule, PyObject *Py_UNUSED(ignored))
+{
+    AsyncQueryHandle *handle;
+    if (!(handle = (AsyncQueryHandle *) PyCapsule_GetPointer(capsule, async_query_capsule_name))){
+        return NULL;
+    }
+    AsyncQuery &async = *handle->async;
+    PyObject *fd;
+    if (!(fd = PyLong_FromLong(async.fds[0]))){
+        return NULL;
+    }
+    bool removed = PyObject_CallMethodDrop(handle->loop, "remove_reader", fd);
+    Py_DECREF(fd);
+    if (!removed){
+        return NULL;
+    }
+    if (!async.finished.load(std::memory_order_acquire)){
+        PyErr_SetString(PyExc_RuntimeError, "Async query signalled before it finished.");
+        return NULL;
+    }
+
+    PyObject *done;
+    if (!(done = PyObject_CallMethod(handle->future, "done", NULL))){
+        return NULL;
+    }
+    int is_done = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (is_done < 0){
+        return NULL;
+    }
+    if (is_done){
+        // cancelled, nobody takes the result
+        if (!async.failed && async.query.shm_output){
+            unlinkSharedMemory(async.query.shm.name);
+        }
+        Py_RETURN_NONE;
+    }
+
+    PyObject *result = NULL;
+    if (async.failed){
+        PyErr_SetString(PyExc_RuntimeError, async.error.c_str());
+    }else{
+        result = PyObject_FromDataQuery(async.query, handle->format);
+    }
+    bool completed;
+    if (result){
+        completed = PyObject_CallMethodDrop(handle->future, "set_result", result);
+        Py_DECREF(result);
+    }else{
+        // hand the exception over to the coroutine awaiting the future
+        PyObject *type, *value, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        PyErr_NormalizeException(&type, &value, &traceback);
+        if (traceback){
+            PyException_SetTraceback(value, traceback);
+        }
+        completed = PyObject_CallMethodDrop(handle->future, "set_exception", value);
+        Py_XDECREF(type);
+        Py_XDECREF(value);
+        Py_XDECREF(traceback);
+    }
+    // the samples are converted, release them before the loop drops the callbacks
+    async.query.samples.clear();
+    if (!completed){
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+    Done callback of the future: a cancelled future cancels the query,
+    which stops reading with the next sample.
+*/
+static PyObject *
+AsyncQuery_done(PyObject *capsule, PyObject *future)
+{
+    AsyncQueryHandle *handle;
+    if (!(handle = (AsyncQueryHandle *) PyCapsule_GetPointer(capsule, async_query_capsule_name))){
+        return NULL;
+    }
+    PyObject *cancelled;
+    if (!(cancelled = PyObject_CallMethod(future, "cancelled", NULL))){
+        return NULL;
+    }
+    int is_cancelled = PyObject_IsTrue(cancelled);
+    Py_DECREF(cancelled);
+    if (is_cancelled < 0){
+        return NULL;
+    }
+    if (is_cancelled){
+        handle->async->control.cancelled = true;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef AsyncQuery_ready_def = {"_ready", (PyCFunction)AsyncQuery_ready, METH_NOARGS, NULL};
+static PyMethodDef AsyncQuery_done_def = {"_done", (PyCFunction)AsyncQuery_done, METH_O, NULL};
+
+/*
+    Binds a loop callback to the capsule of a handle and registers it by calling
+    method of object with the arguments (first, callback), or (callback) if first is NULL.
+    Returns false with PyExc set on failure.
+*/
+static bool
+AsyncQuery_register(PyObject *capsule, PyMethodDef *def, PyObject *object, const char *method, PyObject *first)
+{
+    PyObject *callback;
+    if (!(callback = PyCFunction_New(def, capsule))){
+        return false;
+    }
+    PyObject *result = first ? PyObject_CallMethod(object, method, "(OO)", first, callback)
+                             : PyObject_CallMethod(object, method, "(O)", callback);
+    Py_DECREF(callback);
+    if (!result){
+        return false;
+    }
+    Py_DECREF(result);
+    return true;
+}
+
+/*
+    Starts a get_data() in the async pool, see archiveexport_get_data_async.
+    Arguments are already parsed. Returns a new asyncio future of the running loop.
+*/
+static PyObject *
+getDataAsync(PyObject *module, const char *index_name, PyObject *channel_names, const char *pattern,
+             const epicsTime &start, const epicsTime &end,
+             const OutputFormat &format, ReaderFactory::How how, double delta, int threads,
+             Py_ssize_t max_samples)
+{
+    std::shared_ptr<AsyncQuery> async;
+    try{
+        async = std::make_shared<AsyncQuery>();
+    }catch (std::exception &e){
+        return PyErr_NoMemory();
+    }
+    if (!parseDataQuery(async->query, NULL, index_name, channel_names, pattern, start, end,
+                        format, how, delta, threads, max_samples)){
+        return NULL;
+    }
+    async->query.control = &async->control;
+
+    PyObject *asyncio;
+    if (!(asyncio = PyImport_ImportModule("asyncio"))){
+        return NULL;
+    }
+#if PY_VERSION_HEX >= 0x03070000
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+#else
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_event_loop", NULL);
+#endif
+    Py_DECREF(asyncio);
+    if (!loop){
+        return NULL;
+    }
+    PyObject *future;
+    if (!(future = PyObject_CallMethod(loop, "create_future", NULL))){
+        Py_DECREF(loop);
+        return NULL;
+    }
+
+    if (pipe(async->fds) != 0){
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(loop);
+        Py_DECREF(future);
+        return NULL;
+    }
+    fcntl(async->fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(async->fds[1], F_SETFD, FD_CLOEXEC);
+
+    AsyncQueryHandle *handle;
+    try{
+        handle = new AsyncQueryHandle();
+    }catch (std::exception &e){
+        Py_DECREF(loop);
+        Py_DECREF(future);
+        return PyErr_NoMemory();
+    }
+    handle->async = async;
+    handle->loop = loop;       // the handle takes over both references
+    handle->future = future;
+    Py_INCREF(module);
+    handle->module = module;
+    handle->format = format;
+    Py_XINCREF(handle->format.numpy_empty);
+    PyObject *capsule;
+    if (!(capsule = PyCapsule_New(handle, async_query_capsule_name, AsyncQuery_CapsuleDestructor))){
+        Py_DECREF(handle->module);
+        Py_DECREF(loop);
+        Py_DECREF(future);
+        Py_XDECREF(handle->format.numpy_empty);
+        delete handle;
+        return NULL;
+    }
+    Py_INCREF(future); // returned
+
+    PyObject *fd;
+    if (!(fd = PyLong_FromLong(async->fds[0]))){
+        Py_DECREF(capsule);
+        Py_DECREF(future);
+        return NULL;
+    }
+    if (!AsyncQuery_register(capsule, &AsyncQuery_ready_def, loop, "add_reader", fd)){
+        Py_DECREF(fd);
+        Py_DECREF(capsule);
+        Py_DECREF(future);
+        return NULL;
+    }
+    bool started = AsyncQuery_register(capsule, &AsyncQuery_done_def, future, "add_done_callback", NULL);
+    if (started){
+        try{
+            TaskPool::shared().submit([async](){
+                try{
+                    async->query.run();
+                }catch (std::exception &e){
+                    async->failed = true;
+                    async->error = e.what();
+                }
+                async->finished.store(true, std::memory_order_release);
+                char byte = 1;
+                while (write(async->fds[1], &byte, 1) < 0 && errno == EINTR)
+                    ;
+            });
+        }catch (std::exception &e){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+            started = false;
+        }
+    }
+    if (!started){
+        PyObject *type, *value, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        PyObject_CallMethodDrop(loop, "remove_reader", fd);
+        PyErr_Clear();
+        PyErr_Restore(type, value, traceback);
+        Py_DECREF(fd);
+        Py_DECREF(capsule);
+        Py_DECREF(future);
+        return NULL;
+    }
+    Py_DECREF(fd);
+    Py_DECREF(capsule); // the loop and the future hold it until the query is done
+    return future;
+}
+
+/*
+    Callable from python: archiverexport.get_data_async()
+    Arguments:
+        same as get_data() except progress, progress_every and cancel
+
+    Returns an asyncio future of the running event loop, which gets what get_data()
+    returns:
+        data = await archiveexport.get_data_async(index_name=..., channels=[...], ...)
+
+    The channels are read by a native thread pool shared by all async queries,
+    so the event loop keeps running and many queries run at the same time without
+    a Python thread each. Only the conversion of the samples to python objects
+    runs in the loop. Cancelling the future (or the task awaiting it) stops
+    the read with the next sample.
+*/
+static PyObject *
+archiveexport_get_data_async(PyObject *self, PyObject *args, PyObject *keywds)
+{
+
+    char *index_name = NULL;
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *layout   = NULL;
+    char *how      = NULL;
+    double delta   = 0.0;
+    int threads    = 1;
+    Py_ssize_t max_samples = 0;
+    char *pattern  = NULL;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"index_name", 
+                        (char *)"channels", 
+                        (char *)"start", 
+                        (char *)"end",
+                        (char *)"get_units", 
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"threads",
+                        (char *)"layout",
+                        (char *)"how",
+                        (char *)"delta",
+                        (char *)"max_samples",
+                        (char *)"pattern",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$O!O&O&pppsissdnzz", kwlist, 
+                                        &index_name, 
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start, 
+                                        EpicsTime_FromPyObjectConverter, (void*) &end,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &threads,
+                                        &layout,
+                                        &how,
+                                        &delta,
+                                        &max_samples,
+                                        &pattern,
+                                        &timestamps
+                                     ) 
+        )
+    {
+        return NULL;
+    }
+
+    ReaderFactory::How reader_how;
+    if (!parseReaderHow(reader_how, how, delta)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_Get(self);
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, layout, timestamps)){
+        return NULL;
+    }
+    PyObject *result = getDataAsync(self, index_name, channel_names, pattern, start, end, format, reader_how, delta, threads, max_samples);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+/*
+    Python type archiveexport.DataIterator, returned by iter_data(). Yields
+    (channel_name, values) tuples, values being at most chunk_size samples of the
+    channel in the format get_data() uses for a whole channel. A channel without
+    samples yields one empty chunk.
+    The samples are read through an Archive, either the one iter_data() was called
+    on or one opened for the iterator only, which keeps the reader position between
+    the chunks.
+*/
+struct DataIterator
+{
+    DataIterator() : archive(0), start(), end(), how(ReaderFactory::Raw), delta(0.0),
+                     chunk_size(0), max_samples(0), channel(0), cursor(0),
+                     yielded(false), running(false)
+    {}
+
+    Archive *archive;
+    AutoPtr<Archive> own_archive; // opened by iter_data()
+    std::vector<stdString> names;
+    epicsTime start;
+    epicsTime end;
+    ReaderFactory::How how;
+    double delta;
+    size_t chunk_size;
+    size_t max_samples; // per channel, 0 for no limit
+
+    size_t channel;  // index of the channel read next
+    size_t cursor;   // archive cursor of the channel, 0 if not open
+    bool   yielded;  // yielded a chunk of the channel
+    bool   running;  // next() is reading without the GIL
+};
+
+typedef struct {
+    PyObject_HEAD
+    DataIterator *it;
+    PyObject *archive_object; // Archive the iterator was created from, or NULL
+    PyObject *channel_names;  // copy of the channels argument
+    OutputFormat format;
+} DataIteratorObject;
+
+/*
+    Closes the cursor of the current channel and the archive opened for the iterator,
+    so no more chunks are read. The GIL must be released.
+*/
+static void
+DataIterator_closeArchive(DataIterator *it)
+{
+    if (it->cursor){
+        it->archive->closeCursor(it->cursor);
+        it->cursor = 0;
+    }
+    it->channel = it->names.size();
+    it->own_archive = 0;
+}
+
+static void
+DataIterator_dealloc(DataIteratorObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    if (self->it){
+        DataIterator *it = self->it;
+        Py_BEGIN_ALLOW_THREADS
+        DataIterator_closeArchive(it);
+        delete it;
+        Py_END_ALLOW_THREADS
+    }
+    Py_XDECREF(self->archive_object);
+    Py_XDECREF(self->channel_names);
+    Py_XDECREF(self->format.numpy_empty);
+
+    type->tp_free((PyObject *) self);
+#if PY_VERSION_HEX >= 0x03080000
+    Py_DECREF(type); // instances of heap types own a reference to their type
+#endif
+}
+
+static PyObject *
+DataIterator_nextLocked(DataIteratorObject *self)
+{
+    DataIterator *it = self->it;
+    if (it->running){
+        PyErr_SetString(PyExc_ValueError, "iterator already executing");
+        return NULL;
+    }
+
+    if (it->channel < it->names.size() && !it->archive->isOpen()){
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed archive.");
+        return NULL;
+    }
+
+    while (it->channel < it->names.size()){
+        // read the next chunk without holding the GIL
+        ChannelSamples samples;
+        bool more = false;
+        stdString error;
+        bool failed = false;
+        it->running = true;
+        Py_BEGIN_ALLOW_THREADS
+        try{
+            if (!it->cursor){
+                it->cursor = it->archive->openCursor(it->names[it->channel], it->start, it->end,
+                                                     it->how, it->delta, it->max_samples);
+                it->yielded = false;
+            }
+            more = it->archive->readCursor(it->cursor, it->chunk_size, samples);
+            if (!more){
+                it->archive->closeCursor(it->cursor);
+                it->cursor = 0;
+            }
+        }catch (std::exception &e){
+            failed = true;
+            error = e.what();
+            DataIterator_closeArchive(it);
+        }
+        Py_END_ALLOW_THREADS
+        it->running = false;
+
+        if (failed){
+            PyErr_SetString(PyExc_RuntimeError, error.c_str());
+            return NULL;
+        }
+
+        size_t channel = it->channel;
+        if (!more)
+            ++it->channel;
+        if (samples.size() == 0 && (more || it->yielded))
+            continue; // nothing to yield in this chunk
+        it->yielded = true;
+
+        PyObject *values;
+        if (!(values = PyObject_FromChannel(samples, self->format))){
+            return NULL;
+        }
+
+        PyObject *channel_name = PyList_GetItem(self->channel_names, channel);
+        PyObject *result;
+        if (!(result = PyTuple_Pack(2, channel_name, values))){
+            Py_DECREF(values);
+            return NULL;
+        }
+        Py_DECREF(values);
+        return result;
+    }
+
+    return NULL; // StopIteration
+}
+
+/*
+    The critical section makes checking and setting running atomic in free-threaded
+    builds, it is suspended while the chunk is read without the GIL.
+*/
+static PyObject *
+DataIterator_next(DataIteratorObject *self)
+{
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = DataIterator_nextLocked(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
+}
+
+static PyObject *
+DataIterator_close(DataIteratorObject *self, PyObject *Py_UNUSED(ignored))
+{
+    DataIterator *it = self->it;
+    bool running;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!(running = it->running)){
+        it->running = true;
+        Py_BEGIN_ALLOW_THREADS
+        DataIterator_closeArchive(it);
+        Py_END_ALLOW_THREADS
+        it->running = false;
+    }
+    Py_END_CRITICAL_SECTION();
+    if (running){
+        PyErr_SetString(PyExc_ValueError, "iterator already executing");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef DataIteratorMethods[] = {
+    {"close", (PyCFunction)DataIterator_close, METH_NOARGS, "Stop reading and close the files."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyType_Slot DataIteratorSlots[] = {
+    {Py_tp_dealloc,  (void *)DataIterator_dealloc},
+    {Py_tp_iter,     (void *)PyObject_SelfIter},
+    {Py_tp_iternext, (void *)DataIterator_next},
+    {Py_tp_methods,  (void *)DataIteratorMethods},
+    {0, NULL}
+};
+
+static PyType_Spec DataIteratorSpec = {
+    "archiveexport.DataIterator",
+    sizeof(DataIteratorObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    DataIteratorSlots
+};
+
+/*
+    Creates a DataIterator reading from archive, or from the index opened by name if
+    archive is NULL. archive_object is the Archive python object the archive belongs to.
+*/
+static PyObject *
+iterData(Archive *archive, PyObject *archive_object, const char *index_name,
+         PyObject *channel_names, const epicsTime &start, const epicsTime &end,
+         const OutputFormat &format, ReaderFactory::How how, double delta, int chunk_size,
+         Py_ssize_t max_samples)
+{
+    if (chunk_size < 1){
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be at least 1.");
+        return NULL;
+    }
+    if (max_samples < 0){
+        PyErr_SetString(PyExc_ValueError, "max_samples must not be negative.");
+        return NULL;
+    }
+    if (format.shm){
+        PyErr_SetString(PyExc_ValueError, "output=\"shm\" is supported by get_data only.");
+        return NULL;
+    }
+
+    DataIteratorObject *self;
+    if (!(self = PyObject_New(DataIteratorObject, format.state->data_iterator_type))){
+        return NULL;
+    }
+    self->archive_object = NULL;
+    self->channel_names = NULL;
+    self->format = format;
+    Py_XINCREF(self->format.numpy_empty);
+    try{
+        self->it = new DataIterator();
+    }catch (std::exception &e){
+        self->it = NULL;
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    DataIterator *it = self->it;
+
+    if (!(self->channel_names = channel_names ? PyList_GetSlice(channel_names, 0, PyList_Size(channel_names))
+                                              : PyList_New(0)) ||
+        !parseChannelNames(self->channel_names, it->names)){
+        Py_DECREF(self);
+        return NULL;
+    }
+    it->start = start;
+    it->end = end;
+    it->how = how;
+    it->delta = delta;
+    it->chunk_size = chunk_size;
+    it->max_samples = max_samples;
+
+    if (archive){
+        it->archive = archive;
+        Py_INCREF(archive_object);
+        self->archive_object = archive_object;
+        return (PyObject *) self;
+    }
+
+    // open the index without holding the GIL
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        it->own_archive = new Archive(index_name);
+        it->archive = it->own_archive;
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *) self;
+}
+
+/*
+    Callable from python: archiverexport.iter_data()
+    Arguments:
+        same as get_data() except threads, pattern, progress, progress_every and cancel, and
+        chunk_size (optional) ... maximum number of samples per chunk (default 100000)
+
+    Returns a DataIterator yielding (channel_name, values) tuples, values being a part
+    of what get_data() returns for the channel:
+        ("channel_name1", [{"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}, ...])
+        ("channel_name1", [...])
+        ("channel_name2", [...])
+        ...
+    The channels are read one after the other, holding at most one chunk in memory.
+*/
+static PyObject *
+archiveexport_iter_data(PyObject *self, PyObject *args, PyObject *keywds)
+{
+
+    char *index_name = NULL;
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *layout   = NULL;
+    char *how      = NULL;
+    double delta   = 0.0;
+    int chunk_size = 100000;
+    Py_ssize_t max_samples = 0;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"index_name", 
+                        (char *)"channels", 
+                        (char *)"start", 
+                        (char *)"end",
+                        (char *)"get_units", 
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"chunk_size",
+                        (char *)"layout",
+                        (char *)"how",
+                        (char *)"delta",
+                        (char *)"max_samples",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$O!O&O&pppsissdnz", kwlist, 
+                                        &index_name, 
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start, 
+                                        EpicsTime_FromPyObjectConverter, (void*) &end,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &chunk_size,
+                                        &layout,
+                                        &how,
+                                        &delta,
+                                        &max_samples,
+                                        &timestamps
+                                     ) 
+        )
+    {
+        return NULL;
+    }
+
+    ReaderFactory::How reader_how;
+    if (!parseReaderHow(reader_how, how, delta)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_Get(self);
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, layout, timestamps)){
+        return NULL;
+    }
+    PyObject *result = iterData(NULL, NULL, index_name, channel_names, start, end, format, reader_how, delta, chunk_size, max_samples);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+/*
+    Estimates the size of reading channel_names from the archive if it is given,
+    else from the index opened by name, see estimateChannel.
+    Returns dict of dicts {"channel_name": {"samples": n, "bytes": n, "blocks": n}, ...}
+*/
+static PyObject *
+estimateData(const ResultKeys &keys, Archive *archive, const char *index_name, PyObject *channel_names,
+             const epicsTime &start, const epicsTime &end)
+{
+    std::vector<stdString> names;
+    if (!parseChannelNames(channel_names, names)){
+        return NULL;
+    }
+
+    // walk the index without holding the GIL
+    std::vector<ChannelEstimate> estimates;
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        if (archive){
+            archive->estimateChannels(names, start, end, estimates);
+        }else{
+            estimateChannels(index_name, names, start, end, estimates);
+        }
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *container_dict;
+    if(!(container_dict = PyDict_New())){
+        return NULL;
+    }
+    try{
+        for (size_t i = 0; i < names.size(); ++i){
+            PyObject *channel_name;
+            if(!(channel_name = PyUnicode_FromString(names[i].c_str()))){
+                throw std::runtime_error("Channel name could not be created.");
+            }
+            PyObject *estimate_dict = PyDict_New();
+            PyDict_SetItemDECREF(container_dict, channel_name, estimate_dict);
+            PyDict_SetItemDECREFItem(estimate_dict, keys[KEY_SAMPLES], PyLong_FromSize_t(estimates[i].samples));
+            PyDict_SetItemDECREFItem(estimate_dict, keys[KEY_BYTES], PyLong_FromSize_t(estimates[i].bytes));
+            PyDict_SetItemDECREFItem(estimate_dict, keys[KEY_BLOCKS], PyLong_FromSize_t(estimates[i].blocks));
+        }
+    }catch (std::exception &e){
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        Py_DECREF(container_dict);
+        return NULL;
+    }
+    return container_dict;
+}
+
+/*
+    Callable from python: archiverexport.estimate()
+    Arguments:
+        index_name            ... path to the index file
+        channels              ... list of channel names
+        start (optional)      ... start time, same types as for get_data()
+        end (optional)        ... end time, same types as for get_data()
+
+    Returns Dict of dicts with the estimated size of get_data() with the same
+    arguments, reading only the index and the headers of the data blocks:
+        {
+            "channel_name1": {"samples": samples, "bytes": bytes, "blocks": blocks},
+            ...
+        }
+*/
+static PyObject *
+archiveexport_estimate(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    char *index_name = NULL;
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+
+    char *kwlist[] = {  (char *)"index_name",
+                        (char *)"channels",
+                        (char *)"start",
+                        (char *)"end",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "s|$O!O&O&", kwlist,
+                                        &index_name,
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start,
+                                        EpicsTime_FromPyObjectConverter, (void*) &end
+                                     )
+        )
+    {
+        return NULL;
+    }
+
+    return estimateData(ModuleState_Get(self)->keys, NULL, index_name, channel_names, start, end);
+}
+
+/*
+    Callable from python: archiverexport.set_read_method()
+    Arguments:
+        method                ... "mmap", "pread" or "stdio", see FileReader
+
+    Selects how index and data files opened from now on are read.
+    Returns the previous method.
+*/
+static PyObject *
+archiveexport_set_read_method(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    char *method_name = NULL;
+
+    char *kwlist[] = {(char *)"method", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s", kwlist, &method_name)){
+        return NULL;
+    }
+    FileReader::Method method;
+    if (!FileReader::parseMethod(method_name, method)){
+        PyErr_Format(PyExc_ValueError, "method must be \"mmap\", \"pread\" or \"stdio\", not \"%s\".", method_name);
+        return NULL;
+    }
+    const char *previous = FileReader::getName(FileReader::getDefaultMethod());
+    FileReader::setDefaultMethod(method);
+    return PyUnicode_FromString(previous);
+}
+
+/*
+    Callable from python: archiverexport.read_stats()
+    Arguments:
+        reset (optional)      ... reset the counters after reading them
+
+    Returns the reads of index and data files of all threads per method:
+        {
+            "mmap": {"reads": reads, "bytes": bytes, "sizes": [reads < 64 bytes, < 256 bytes, ...]},
+            ...
+        }
+*/
+static PyObject *
+archiveexport_read_stats(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    int reset = false;
+
+    char *kwlist[] = {(char *)"reset", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|$p", kwlist, &reset)){
+        return NULL;
+    }
+
+    const ResultKeys &keys = ModuleState_Get(self)->keys;
+    PyObject *result;
+    if(!(result = PyDict_New())){
+        return NULL;
+    }
+    try{
+        for (int m = 0; m < FileReader::num_methods; ++m){
+            FileReader::Stats stats;
+            FileReader::getStats((FileReader::Method) m, stats);
+            PyObject *method_dict = PyDict_New();
+            if (!method_dict || PyDict_SetItemString(result, FileReader::getName((FileReader::Method) m), method_dict) != 0){
+                Py_XDECREF(method_dict);
+                throw std::runtime_error("Read statistics could not be created.");
+            }
+            Py_DECREF(method_dict);
+            PyDict_SetItemDECREFItem(method_dict, keys[KEY_READS], PyLong_FromSize_t(stats.reads));
+            PyDict_SetItemDECREFItem(method_dict, keys[KEY_BYTES], PyLong_FromSize_t(stats.bytes));
+            PyObject *sizes = PyList_New(0);
+            PyDict_SetItemDECREFItem(method_dict, keys[KEY_SIZES], sizes);
+            for (int i = 0; i < FileReader::size_buckets; ++i){
+                PyList_AppendDECREF(sizes, PyLong_FromSize_t(stats.sizes[i]));
+            }
+        }
+    }catch (std::exception &e){
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        Py_DECREF(result);
+        return NULL;
+    }
+    if (reset){
+        FileReader::resetStats();
+    }
+    return result;
+}
+
+/*
+    Copies a sequence of times (datetime, numpy.datetime64 or seconds since the Unix
+    epoch, see EpicsTime_FromPyObjectConverter) to times, checking that they are sorted.
+    Sets PyExc and returns false on failure.
+*/
+static bool
+parseTimes(PyObject *py_times, std::vector<epicsTime> &times)
+{
+    PyObject *seq;
+    if (!(seq = PySequence_Fast(py_times, "times must be a sequence of datetimes."))){
+        return false;
+    }
+    // PySequence_Fast passes a list through, copy it in case other threads change it
+    if (PyList_Check(seq)){
+        PyObject *tuple = PyList_AsTuple(seq);
+        Py_DECREF(seq);
+        if (!(seq = tuple)){
+            return false;
+        }
+    }
+    // not PySequence_Fast_GET_ITEM, its assert clashes with ToolsConfig.h
+    Py_ssize_t n = PySequence_Size(seq);
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    times.resize(n);
+    for (Py_ssize_t i = 0; i < n; ++i){
+        if (!EpicsTime_FromPyObjectConverter(items[i], &times[i])){
+            Py_DECREF(seq);
+            return false;
+        }
+        if (i > 0 && times[i] < times[i - 1]){
+            PyErr_SetString(PyExc_ValueError, "times must be sorted.");
+            Py_DECREF(seq);
+            return false;
+        }
+    }
+    Py_DECREF(seq);
+    return true;
+}
+
+/*
+    Sets "valid" of a numpy dict to a bool array of valid[first...first + n],
+    n being the length of the value array. Throws std::runtime_error on failure.
+*/
+static void
+PyDict_SetValidArray(PyObject *dict, PyObject *numpy_empty, const std::vector<bool> &valid, size_t &first,
+                     const ResultKeys &keys)
+{
+    Py_ssize_t n;
+    if ((n = PyObject_Length(PyDict_GetItem(dict, keys[KEY_VALUE]))) < 0){
+        throw std::runtime_error("Cannot get length of the value array.");
+    }
+    Py_buffer view;
+    PyObject *array;
+    if (!(array = PyArray_EmptyWithBuffer(numpy_empty, n, "?", &view))){
+        throw std::runtime_error("Cannot create valid array.");
+    }
+    bool *dst = (bool *) view.buf;
+    for (Py_ssize_t i = 0; i < n; ++i){
+        dst[i] = valid[first++];
+    }
+    PyBuffer_Release(&view);
+    PyDict_SetItemDECREFItem(dict, keys[KEY_VALID], array);
+}
+
+/*
+    Converts the result of readValuesAt. Rows without value are None with
+    output="dict", with output="numpy" every dict gets a "valid" bool array.
+    Returns NULL with PyExc set on failure.
+*/
+static PyObject *
+PyObject_FromValuesAt(const ChannelSamples &samples, const std::vector<bool> &valid, const OutputFormat &format)
+{
+    PyObject *values;
+    if (!(values = PyObject_FromChannel(samples, format))){
+        return NULL;
+    }
+    try{
+        if (format.numpy_empty){
+            size_t first = 0;
+            if (PyDict_Check(values)){
+                PyDict_SetValidArray(values, format.numpy_empty, valid, first, format.state->keys);
+            }else{
+                for (Py_ssize_t s = 0; s < PyList_Size(values); ++s){
+                    PyDict_SetValidArray(PyList_GetItem(values, s), format.numpy_empty, valid, first, format.state->keys);
+                }
+            }
+        }else{
+            for (size_t i = 0; i < valid.size(); ++i){
+                if (!valid[i]){
+                    Py_INCREF(Py_None);
+                    PyList_SetItem(values, i, Py_None);
+                }
+            }
+        }
+    }catch (std::exception &e){
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        Py_DECREF(values);
+        return NULL;
+    }
+    return values;
+}
+
+/*
+    Reads the values of channel_name at times from the archive if it is given,
+    else from the index opened by name, see archiveexport_get_values_at.
+*/
+static PyObject *
+getValuesAt(Archive *archive, const char *index_name, const char *channel_name,
+            PyObject *py_times, const OutputFormat &format)
+{
+    if (format.arrow || format.shm || format.info_segments){
+        PyErr_SetString(PyExc_ValueError, "get_values_at supports output=\"dict\" or \"numpy\" with layout=\"rows\".");
+        return NULL;
+    }
+    std::vector<epicsTime> times;
+    if (!parseTimes(py_times, times)){
+        return NULL;
+    }
+
+    // read without holding the GIL
+    ChannelSamples samples;
+    std::vector<bool> valid;
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        if (archive){
+            archive->readValuesAt(channel_name, times, samples, valid);
+        }else{
+            readValuesAt(index_name, channel_name, times, samples, valid);
+        }
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return PyObject_FromValuesAt(samples, valid, format);
+}
+
+/*
+    Callable from python: archiverexport.get_values_at()
+    Arguments:
+        index_name            ... path to the index file
+        channel               ... channel name
+        times                 ... sorted sequence of times, same types as start for get_data()
+        get_units, get_status, get_info, output, timestamps ... same as for get_data(),
+                                 output is "dict" (default) or "numpy"
+
+    Returns the value the channel had at each of the times, the last sample
+    before-or-at the time (sample-and-hold):
+        [{"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}, None, ...]
+    None where the channel had no value. "seconds" and "nanoseconds" are the
+    timestamp of the sample. With output="numpy" a dict of numpy arrays as
+    get_data() returns for a channel, with an additional "valid" bool array.
+    The channel is read in one pass, the times only move the reader forward.
+*/
+static PyObject *
+archiveexport_get_values_at(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    char *index_name   = NULL;
+    char *channel_name = NULL;
+    PyObject *times    = NULL;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"index_name",
+                        (char *)"channel",
+                        (char *)"times",
+                        (char *)"get_units",
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "ssO|$pppsz", kwlist,
+                                        &index_name,
+                                        &channel_name,
+                                        &times,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &timestamps
+                                     )
+        )
+    {
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_Get(self);
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, NULL, timestamps)){
+        return NULL;
+    }
+    PyObject *result = getValuesAt(NULL, index_name, channel_name, times, format);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+/*
+    Python type archiveexport.Archive(index_name), see class Archive.
+    Keeps the index and data files open for many queries:
+
+        with archiveexport.Archive(index_name) as archive:
+            channels = archive.list(pattern="...")
+            data = archive.get_data(channels=channels, start=..., end=...)
+
+    list(), catalog(), get_data(), iter_data(), get_values_at() and estimate() take the same arguments as
+    the module functions, except index_name and threads.
+*/
+typedef struct {
+    PyObject_HEAD
+    Archive *archive;
+} ArchiveObject;
+
+static PyObject *
+Archive_new(PyTypeObject *type, PyObject *args, PyObject *keywds)
+{
+    char *index_name = NULL;
+
+    char *kwlist[] = {(char *)"index_name", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s", kwlist, &index_name)){
+        return NULL;
+    }
+
+    ArchiveObject *self;
+    if (!(self = (ArchiveObject *) type->tp_alloc(type, 0))){
+        return NULL;
+    }
+
+    // open the index without holding the GIL
+    stdString error;
+    bool failed = false;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        self->archive = new Archive(index_name);
+    }catch (std::exception &e){
+        failed = true;
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed){
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *) self;
+}
+
+static void
+Archive_dealloc(ArchiveObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    // waits for the archive thread to close the files
+    Archive *archive = self->archive;
+    Py_BEGIN_ALLOW_THREADS
+    delete archive;
+    Py_END_ALLOW_THREADS
+
+    type->tp_free((PyObject *) self);
+#if PY_VERSION_HEX >= 0x03080000
+    Py_DECREF(type); // instances of heap types own a reference to their type
+#endif
+}
+
+/*
+    Sets ValueError and returns false if the archive has been closed.
+*/
+static bool
+Archive_checkOpen(ArchiveObject *self)
+{
+    if (!self->archive->isOpen()){
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed archive.");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *
+Archive_list(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    char *pattern = NULL;
+
+    char *kwlist[] = {(char *)"pattern", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|$s", kwlist, &pattern)){
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    return listChannelNames(self->archive, NULL, pattern);
+}
+
+static PyObject *
+Archive_catalog(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    char *pattern = NULL;
+
+    char *kwlist[] = {(char *)"pattern", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|$s", kwlist, &pattern)){
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    return catalogChannelNames(ModuleState_FromType(Py_TYPE(self))->keys, self->archive, NULL, pattern, 1);
+}
+
+static PyObject *
+Archive_get_data(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *layout   = NULL;
+    char *how      = NULL;
+    double delta   = 0.0;
+    Py_ssize_t max_samples = 0;
+    char *pattern  = NULL;
+    PyObject *progress = NULL;
+    Py_ssize_t progress_every = 100000;
+    PyObject *cancel = NULL;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"channels", 
+                        (char *)"start", 
+                        (char *)"end",
+                        (char *)"get_units", 
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"layout",
+                        (char *)"how",
+                        (char *)"delta",
+                        (char *)"max_samples",
+                        (char *)"pattern",
+                        (char *)"progress",
+                        (char *)"progress_every",
+                        (char *)"cancel",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "|$O!O&O&pppsssdnzOnOz", kwlist, 
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start, 
+                                        EpicsTime_FromPyObjectConverter, (void*) &end,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &layout,
+                                        &how,
+                                        &delta,
+                                        &max_samples,
+                                        &pattern,
+                                        &progress,
+                                        &progress_every,
+                                        &cancel,
+                                        &timestamps
+                                     ) 
+        )
+    {
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    ReaderFactory::How reader_how;
+    if (!parseReaderHow(reader_how, how, delta)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_FromType(Py_TYPE(self));
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, layout, timestamps)){
+        return NULL;
+    }
+    PyObject *result = getData(self->archive, NULL, channel_names, pattern, start, end, format, reader_how, delta, 1, max_samples,
+                               progress, progress_every, cancel);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+static PyObject *
+Archive_iter_data(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *layout   = NULL;
+    char *how      = NULL;
+    double delta   = 0.0;
+    int chunk_size = 100000;
+    Py_ssize_t max_samples = 0;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"channels", 
+                        (char *)"start", 
+                        (char *)"end",
+                        (char *)"get_units", 
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"chunk_size",
+                        (char *)"layout",
+                        (char *)"how",
+                        (char *)"delta",
+                        (char *)"max_samples",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "|$O!O&O&pppsissdnz", kwlist, 
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start, 
+                                        EpicsTime_FromPyObjectConverter, (void*) &end,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &chunk_size,
+                                        &layout,
+                                        &how,
+                                        &delta,
+                                        &max_samples,
+                                        &timestamps
+                                     ) 
+        )
+    {
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    ReaderFactory::How reader_how;
+    if (!parseReaderHow(reader_how, how, delta)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_FromType(Py_TYPE(self));
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, layout, timestamps)){
+        return NULL;
+    }
+    PyObject *result = iterData(self->archive, (PyObject *) self, NULL, channel_names, start, end, format, reader_how, delta, chunk_size, max_samples);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+static PyObject *
+Archive_get_values_at(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    char *channel_name = NULL;
+    PyObject *times    = NULL;
+    int get_units  = false;
+    int get_status = false;
+    int get_info   = false;
+    char *output   = NULL;
+    char *timestamps = NULL;
+
+    char *kwlist[] = {  (char *)"channel",
+                        (char *)"times",
+                        (char *)"get_units",
+                        (char *)"get_status",
+                        (char *)"get_info",
+                        (char *)"output",
+                        (char *)"timestamps",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "sO|$pppsz", kwlist,
+                                        &channel_name,
+                                        &times,
+                                        &get_units,
+                                        &get_status,
+                                        &get_info,
+                                        &output,
+                                        &timestamps
+                                     )
+        )
+    {
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    ModuleState *state = ModuleState_FromType(Py_TYPE(self));
+    OutputFormat format;
+    if (!parseOutputFormat(format, state, get_units, get_status, get_info, output, NULL, timestamps)){
+        return NULL;
+    }
+    PyObject *result = getValuesAt(self->archive, NULL, channel_name, times, format);
+    Py_XDECREF(format.numpy_empty);
+    return result;
+}
+
+static PyObject *
+Archive_estimate(ArchiveObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *channel_names = NULL;
+    epicsTime start;
+    epicsTime end;
+
+    char *kwlist[] = {  (char *)"channels",
+                        (char *)"start",
+                        (char *)"end",
+                        NULL
+                    };
+
+    if  (!PyArg_ParseTupleAndKeywords(args, keywds, "|$O!O&O&", kwlist,
+                                        &PyList_Type, &channel_names,
+                                        EpicsTime_FromPyObjectConverter, (void*) &start,
+                                        EpicsTime_FromPyObjectConverter, (void*) &end
+                                     )
+        )
+    {
+        return NULL;
+    }
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+
+    return estimateData(ModuleState_FromType(Py_TYPE(self))->keys, self->archive, NULL, channel_names, start, end);
+}
+
+static PyObject *
+Archive_close(ArchiveObject *self, PyObject *Py_UNUSED(ignored))
+{
+    // waits for a query running in another python thread
+    Archive *archive = self->archive;
+    Py_BEGIN_ALLOW_THREADS
+    archive->close();
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+Archive_enter(ArchiveObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (!Archive_checkOpen(self)){
+        return NULL;
+    }
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+static PyObject *
+Archive_exit(ArchiveObject *self, PyObject *args)
+{
+    return Archive_close(self, NULL);
+}
+
+static PyObject *
+Archive_get_closed(ArchiveObject *self, void *closure)
+{
+    return PyBool_FromLong(!self->archive->isOpen());
+}
+
+static PyObject *
+Archive_get_index_name(ArchiveObject *self, void *closure)
+{
+    return PyUnicode_FromString(self->archive->getIndexName().c_str());
+}
+
+static PyMethodDef ArchiveMethods[] = {
+    {"list",      (PyCFunction)Archive_list, METH_VARARGS|METH_KEYWORDS, "Find channels."},
+    {"catalog",   (PyCFunction)Archive_catalog, METH_VARARGS|METH_KEYWORDS, "Find channels with their time range and type."},
+    {"get_data",  (PyCFunction)Archive_get_data, METH_VARARGS|METH_KEYWORDS, "Get data."},
+    {"iter_data", (PyCFunction)Archive_iter_data, METH_VARARGS|METH_KEYWORDS, "Get data in chunks."},
+    {"get_values_at", (PyCFunction)Archive_get_values_at, METH_VARARGS|METH_KEYWORDS, "Get values at many times."},
+    {"estimate",  (PyCFunction)Archive_estimate, METH_VARARGS|METH_KEYWORDS, "Estimate the size of get_data."},
+    {"close",     (PyCFunction)Archive_close, METH_NOARGS, "Close index and data files."},
+    {"__enter__", (PyCFunction)Archive_enter, METH_NOARGS, NULL},
+    {"__exit__",  (PyCFunction)Archive_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyGetSetDef ArchiveGetSet[] = {
+    {(char *)"closed", (getter)Archive_get_closed, NULL, (char *)"True after close().", NULL},
+    {(char *)"index_name", (getter)Archive_get_index_name, NULL, (char *)"Path to the index file.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}  /* Sentinel */
+};
+
+PyDoc_STRVAR(archive_doc, "Archive(index_name)\n\nKeeps an index and its data files open for many queries.");
+
+static PyType_Slot ArchiveSlots[] = {
+    {Py_tp_new,     (void *)Archive_new},
+    {Py_tp_dealloc, (void *)Archive_dealloc},
+    {Py_tp_methods, (void *)ArchiveMethods},
+    {Py_tp_getset,  (void *)ArchiveGetSet},
+    {Py_tp_doc,     (void *)archive_doc},
+    {0, NULL}
+};
+
+static PyType_Spec ArchiveSpec = {
+    "archiveexport.Archive",
+    sizeof(ArchiveObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    ArchiveSlots
+};
+
+/* Export to Python */
+
+static PyMethodDef ArchiveExportMethods[] = {
+    {"list",   (PyCFunction)archiveexport_list, METH_VARARGS|METH_KEYWORDS, "Find channels."},
+    {"catalog",   (PyCFunction)archiveexport_catalog, METH_VARARGS|METH_KEYWORDS, "Find channels with their time range and type."},
+    {"get_data",   (PyCFunction)archiveexport_get_data, METH_VARARGS|METH_KEYWORDS, "Get data."},
+    {"get_data_async",   (PyCFunction)archiveexport_get_data_async, METH_VARARGS|METH_KEYWORDS, "Get data in an asyncio future."},
+    {"iter_data",   (PyCFunction)archiveexport_iter_data, METH_VARARGS|METH_KEYWORDS, "Get data in chunks."},
+    {"get_values_at",   (PyCFunction)archiveexport_get_values_at, METH_VARARGS|METH_KEYWORDS, "Get values at many times."},
+    {"estimate",   (PyCFunction)archiveexport_estimate, METH_VARARGS|METH_KEYWORDS, "Estimate the size of get_data."},
+    {"set_read_method",   (PyCFunction)archiveexport_set_read_method, METH_VARARGS|METH_KEYWORDS, "Select how files are read."},
+    {"read_stats",   (PyCFunction)archiveexport_read_stats, METH_VARARGS|METH_KEYWORDS, "Get file read statistics."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+PyDoc_STRVAR(archiveexport_doc, "This module can extract data from ChannelArchiver files.");
+
+/*
+    Creates a type of the module from spec and adds it as name.
+    Returns a new reference for the module state, or NULL with PyExc set.
+*/
+static PyTypeObject *
+Module_AddType(PyObject *module, PyType_Spec *spec, const char *name)
+{
+    PyObject *type;
+#if PY_VERSION_HEX >= 0x03090000
+    type = PyType_FromModuleAndSpec(module, spec, NULL);
+#else
+    type = PyType_FromSpec(spec);
+#endif
+    if (!type){
+        return NULL;
+    }
+    Py_INCREF(type); // PyModule_AddObject steals one reference
+    if (PyModule_AddObject(module, name, type) < 0){
+        Py_DECREF(type);
+        Py_DECREF(type);
+        return NULL;
+    }
+    return (PyTypeObject *) type;
+}
+
+/*
+    Adds a module attribute holding another reference to tuple.
+    Returns -1 with PyExc set on failure.
+*/
+static int
+Module_AddTuple(PyObject *module, PyObject *tuple, const char *name)
+{
+    Py_INCREF(tuple); // PyModule_AddObject steals one reference
+    if (PyModule_AddObject(module, name, tuple) < 0){
+        Py_DECREF(tuple);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Initializes a new module object, once per (sub)interpreter.
+*/
+static int
+archiveexport_exec(PyObject *module)
+{
+#if PY_VERSION_HEX < 0x03090000
+    if (single_module){
+        PyErr_SetString(PyExc_ImportError, "archiveexport can be loaded only once per process before Python 3.9.");
+        return -1;
+    }
+    single_module = module;
+#endif
+    if (DateTime_Import() < 0){
+        return -1;
+    }
+    ModuleState *state = ModuleState_Get(module);
+    if (ResultKeys_Init(state->keys) < 0 ||
+        !(state->archive_type = Module_AddType(module, &ArchiveSpec, "Archive")) ||
+        !(state->arrow_batch_type = Module_AddType(module, &ArrowBatchSpec, "ArrowBatch")) ||
+        !(state->data_iterator_type = Module_AddType(module, &DataIteratorSpec, "DataIterator")) ||
+        Module_AddTuple(module, state->keys.status_strings, "STATUS_STRINGS") < 0 ||
+        Module_AddTuple(module, state->keys.severity_strings, "SEVERITY_STRINGS") < 0){
+        return -1; // the module is released, archiveexport_clear releases the state
+    }
+    return 0;
+}
+
+static int
+archiveexport_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    ModuleState *state = ModuleState_Get(module);
+    if (!state){
+        return 0; // before Python 3.9 called before the state is allocated
+    }
+    Py_VISIT(state->archive_type);
+    Py_VISIT(state->arrow_batch_type);
+    Py_VISIT(state->data_iterator_type);
+    return 0;
+}
+
+static int
+archiveexport_clear(PyObject *module)
+{
+    ModuleState *state = ModuleState_Get(module);
+    if (!state){
+        return 0;
+    }
+    Py_CLEAR(state->archive_type);
+    Py_CLEAR(state->arrow_batch_type);
+    Py_CLEAR(state->data_iterator_type);
+    ResultKeys_Clear(state->keys);
+    return 0;
+}
+
+static void
+archiveexport_free(void *module)
+{
+    archiveexport_clear((PyObject *) module);
+#if PY_VERSION_HEX < 0x03090000
+    if (single_module == module){
+        single_module = NULL;
+    }
+#endif
+}
+
+/*
+    The module keeps no global python objects, the C++ layers below keep their
+    caches per thread, so it runs in subinterpreters and without the GIL in
+    free-threaded builds. Only subinterpreters that share the main GIL are
+    supported: the datetime C API is shared by all interpreters (see
+    DateTime_Import) and _datetime may not load in one with its own GIL.
+*/
+static PyModuleDef_Slot archiveexport_slots[] = {
+    {Py_mod_exec, (void *)archiveexport_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+    {Py_mod_multiple_interpreters, Py_MOD_MULTIPLE_INTERPRETERS_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030D0000
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
 
 static struct PyModuleDef archiveexportmodule = {
     PyModuleDef_HEAD_INIT,
-    "archiveexport",   /* name of module */
-    archiveexport_doc, /* module documentation, may be NULL */
-    -1,       /* size of per-interpreter state of the module,
-                 or -1 if the module keeps state in global variables. */
-    ArchiveExportMethods
+    "archiveexport",     /* name of module */
+    archiveexport_doc,   /* module documentation, may be NULL */
+    sizeof(ModuleState), /* size of per-interpreter state of the module */
+    ArchiveExportMethods,
+    archiveexport_slots,
+    archiveexport_traverse,
+    archiveexport_clear,
+    archiveexport_free
 };
 
 
 PyMODINIT_FUNC
 PyInit_archiveexport(void)
 {
-    if(!PyDateTimeAPI) PyDateTime_IMPORT;
-    return PyModule_Create(&archiveexportmodule);
+    return PyModuleDef_Init(&archiveexportmodule);
 }
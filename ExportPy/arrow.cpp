@@ -0,0 +1,447 @@
+/* #define AE_DEBUG */
+
+/* C, C++ */
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <new>
+
+/* Tools */
+#include <GenericException.h>
+
+/* Storage */
+#include <RawValue.h>
+
+#include "arrow.h"
+
+/*
+    One array of the batch with its buffers. Buffers are kept as vectors of
+    int64_t, which keeps them 8 byte aligned as recommended by the Arrow spec.
+    A validity buffer is only allocated if the column has nulls.
+*/
+struct ArrowColumn
+{
+    ArrowColumn(const stdString &format, const char *name, int64_t flags = ARROW_FLAG_NULLABLE)
+        : format(format), name(name), flags(flags), length(0), null_count(0)
+    {}
+
+    stdString format;
+    stdString name;
+    int64_t   flags;
+    int64_t   length;
+    int64_t   null_count;
+
+    std::vector< std::vector<int64_t> > data;
+    std::vector<const void *> buffers;
+    std::vector< std::shared_ptr<ArrowColumn> > children;
+    std::shared_ptr<ArrowColumn> dictionary;
+
+    /*
+        Appends a buffer of at least size bytes, returns its start.
+        The memory of earlier buffers does not move when data grows.
+    */
+    void *addBuffer(size_t size)
+    {
+        // never hand out a null pointer, not even for an empty buffer
+        data.push_back(std::vector<int64_t>(size / sizeof(int64_t) + 1));
+        buffers.push_back(&data.back()[0]);
+        return &data.back()[0];
+    }
+
+    /* Appends the validity buffer, null if the column has no nulls */
+    uint8_t *addValidity(bool has_nulls, size_t n)
+    {
+        if (!has_nulls){
+            buffers.push_back(0);
+            return 0;
+        }
+        uint8_t *validity = (uint8_t *) addBuffer((n + 7) / 8);
+        memset(validity, 0xFF, (n + 7) / 8);
+        return validity;
+    }
+};
+
+typedef std::shared_ptr<ArrowColumn> ArrowColumnPtr;
+
+/* Utf8 column of the DBR_TIME_STRING elements of the segment */
+static ArrowColumnPtr makeStringColumn(const SampleSegment &segment, const char *name)
+{
+    ArrowColumnPtr column(new ArrowColumn("u", name));
+    size_t n = segment.size() * segment.count;
+    column->length = n;
+    column->addValidity(false, n);
+    int32_t *offsets = (int32_t *) column->addBuffer((n + 1) * sizeof(int32_t));
+    std::vector<char> chars;
+    offsets[0] = 0;
+    for (size_t i = 0, o = 0; i < segment.size(); ++i){
+        const dbr_string_t *val = (const dbr_string_t *) dbr_value_ptr(segment.get(i), segment.type);
+        for (size_t c = 0; c < segment.count; ++c, ++o){
+            const char *s = val[c];
+            chars.insert(chars.end(), s, s + strnlen(s, MAX_STRING_SIZE));
+            offsets[o + 1] = (int32_t) chars.size();
+        }
+    }
+    char *dst = (char *) column->addBuffer(chars.size());
+    if (!chars.empty())
+        memcpy(dst, &chars[0], chars.size());
+    return column;
+}
+
+/* Fixed width column with the value part of all samples of the segment */
+static ArrowColumnPtr makeFixedColumn(const SampleSegment &segment, const char *format, const char *name)
+{
+    ArrowColumnPtr column(new ArrowColumn(format, name));
+    size_t n = segment.size();
+    size_t value_size = dbr_value_size[segment.type] * segment.count;
+    column->length = n * segment.count;
+    column->addValidity(false, n);
+    char *dst = (char *) column->addBuffer(n * value_size);
+    for (size_t i = 0; i < n; ++i){
+        memcpy(dst + i * value_size, dbr_value_ptr(segment.get(i), segment.type), value_size);
+    }
+    return column;
+}
+
+static ArrowColumnPtr makeValueColumn(const SampleSegment &segment)
+{
+    const char *name = segment.count > 1 ? "item" : "value";
+    ArrowColumnPtr values;
+    switch (segment.type)
+    {
+        case DBR_TIME_STRING: values = makeStringColumn(segment, name); break;
+        case DBR_TIME_CHAR:   values = makeFixedColumn(segment, "C", name); break;
+        case DBR_TIME_ENUM:   values = makeFixedColumn(segment, "S", name); break;
+        case DBR_TIME_SHORT:  values = makeFixedColumn(segment, "s", name); break;
+        case DBR_TIME_LONG:   values = makeFixedColumn(segment, "i", name); break;
+        case DBR_TIME_FLOAT:  values = makeFixedColumn(segment, "f", name); break;
+        case DBR_TIME_DOUBLE: values = makeFixedColumn(segment, "g", name); break;
+        default:
+            throw GenericException(__FILE__, __LINE__, "Unexpected DBR Type %d", (int) segment.type);
+    }
+    if (segment.count <= 1)
+        return values;
+
+    // waveform: one list of count elements per sample
+    char format[32];
+    snprintf(format, sizeof(format), "+w:%zu", (size_t) segment.count);
+    ArrowColumnPtr list(new ArrowColumn(format, "value"));
+    list->length = segment.size();
+    list->addValidity(false, segment.size());
+    list->children.push_back(values);
+    return list;
+}
+
+/* Column of type T with field(value) of all samples of the segment */
+template <typename T, typename F>
+static ArrowColumnPtr makeFieldColumn(const SampleSegment &segment, const char *format, const char *name, F field)
+{
+    ArrowColumnPtr column(new ArrowColumn(format, name));
+    size_t n = segment.size();
+    column->length = n;
+    column->addValidity(false, n);
+    T *dst = (T *) column->addBuffer(n * sizeof(T));
+    for (size_t i = 0; i < n; ++i){
+        dst[i] = field(segment.get(i));
+    }
+    return column;
+}
+
+/*
+    Dictionary encoded state strings of a scalar enum segment. The dictionary holds
+    the states of all CtrlInfos valid for the segment, one after the other, first
+    is the index of the first sample of the segment in the channel.
+*/
+static ArrowColumnPtr makeEnumStringColumn(const SampleSegment &segment,
+                                           const std::vector<CtrlInfoSegment> &infos, size_t first)
+{
+    size_t n = segment.size();
+    std::vector<int32_t> indices(n);
+    std::vector<bool> valid(n, false);
+    std::vector<stdString> states, last_states;
+    size_t null_count = 0, base = 0;
+
+    size_t info = 0;
+    while (info + 1 < infos.size() && infos[info + 1].first <= first)
+        ++info;
+    bool new_info = true;
+    for (size_t i = 0; i < n; ++i){
+        if (info + 1 < infos.size() && infos[info + 1].first <= first + i){
+            while (info + 1 < infos.size() && infos[info + 1].first <= first + i)
+                ++info;
+            new_info = true;
+        }
+        if (new_info && info < infos.size()){
+            // add the states of the info unless they are the same as before
+            const CtrlInfo &ctrl_info = infos[info].info;
+            std::vector<stdString> info_states(ctrl_info.getNumStates());
+            for (size_t s = 0; s < info_states.size(); ++s)
+                ctrl_info.getState(s, info_states[s]);
+            if (info_states != last_states){
+                base = states.size();
+                states.insert(states.end(), info_states.begin(), info_states.end());
+                last_states.swap(info_states);
+            }
+            new_info = false;
+        }
+        size_t state = ((const dbr_time_enum *) segment.get(i))->value;
+        if (state < last_states.size()){
+            indices[i] = (int32_t) (base + state);
+            valid[i] = true;
+        }else{
+            indices[i] = 0;
+            ++null_count;
+        }
+    }
+
+    ArrowColumnPtr column(new ArrowColumn("i", "enum_string"));
+    column->length = n;
+    column->null_count = null_count;
+    uint8_t *validity = column->addValidity(null_count > 0, n);
+    if (validity){
+        for (size_t i = 0; i < n; ++i){
+            if (!valid[i])
+                validity[i / 8] &= (uint8_t) ~(1 << (i % 8));
+        }
+    }
+    int32_t *dst = (int32_t *) column->addBuffer(n * sizeof(int32_t));
+    if (n > 0)
+        memcpy(dst, &indices[0], n * sizeof(int32_t));
+
+    ArrowColumnPtr dictionary(new ArrowColumn("u", "", 0));
+    dictionary->length = states.size();
+    dictionary->addValidity(false, states.size());
+    int32_t *offsets = (int32_t *) dictionary->addBuffer((states.size() + 1) * sizeof(int32_t));
+    size_t total = 0;
+    offsets[0] = 0;
+    for (size_t s = 0; s < states.size(); ++s){
+        total += states[s].length();
+        offsets[s + 1] = (int32_t) total;
+    }
+    char *chars = (char *) dictionary->addBuffer(total);
+    for (size_t s = 0; s < states.size(); ++s){
+        memcpy(chars + offsets[s], states[s].c_str(), states[s].length());
+    }
+    column->dictionary = dictionary;
+    return column;
+}
+
+static ArrowColumnPtr makeBatch(const SampleSegment &segment,
+                                const std::vector<CtrlInfoSegment> &infos, size_t first)
+{
+    ArrowColumnPtr batch(new ArrowColumn("+s", "", 0));
+    batch->length = segment.size();
+    batch->addValidity(false, segment.size());
+    batch->children.push_back(makeFieldColumn<int64_t>(segment, "tsn:UTC", "timestamp", getUnixNanoseconds));
+    batch->children.push_back(makeValueColumn(segment));
+    batch->children.push_back(makeFieldColumn<uint16_t>(segment, "S", "status",
+        [](const RawValue::Data *value){ return (uint16_t) value->status; }));
+    batch->children.push_back(makeFieldColumn<uint16_t>(segment, "S", "severity",
+        [](const RawValue::Data *value){ return (uint16_t) value->severity; }));
+    if (segment.type == DBR_TIME_ENUM && segment.count == 1)
+        batch->children.push_back(makeEnumStringColumn(segment, infos, first));
+    return batch;
+}
+
+ArrowBatch::ArrowBatch(const ChannelSamples &samples, size_t s)
+{
+    size_t first = 0;
+    for (size_t i = 0; i < s; ++i)
+        first += samples.segments[i].size();
+    root = makeBatch(samples.segments[s], samples.infos, first);
+}
+
+ArrowBatch::ArrowBatch(DbrType type, DbrCount count)
+{
+    root = makeBatch(SampleSegment(type, count), std::vector<CtrlInfoSegment>(), 0);
+}
+
+size_t ArrowBatch::size() const
+{
+    return root->length;
+}
+
+/*
+    Exported structs keep the column alive through their private data.
+    Children and dictionary are allocated along with the parent and released by it,
+    unless the consumer moved them out (their release is then already null).
+*/
+struct ExportedSchema
+{
+    ArrowColumnPtr column;
+    std::vector<ArrowSchema *> children;
+    ArrowSchema *dictionary;
+};
+
+struct ExportedArray
+{
+    ArrowColumnPtr column;
+    std::vector<ArrowArray *> children;
+    ArrowArray *dictionary;
+};
+
+template <typename T>
+static void releaseChild(T *child)
+{
+    if (child && child->release)
+        child->release(child);
+    delete child;
+}
+
+static void releaseSchema(ArrowSchema *schema)
+{
+    ExportedSchema *exported = (ExportedSchema *) schema->private_data;
+    for (size_t i = 0; i < exported->children.size(); ++i)
+        releaseChild(exported->children[i]);
+    releaseChild(exported->dictionary);
+    delete exported;
+    schema->release = 0;
+}
+
+static void releaseArray(ArrowArray *array)
+{
+    ExportedArray *exported = (ExportedArray *) array->private_data;
+    for (size_t i = 0; i < exported->children.size(); ++i)
+        releaseChild(exported->children[i]);
+    releaseChild(exported->dictionary);
+    delete exported;
+    array->release = 0;
+}
+
+static void exportSchema(const ArrowColumnPtr &column, ArrowSchema *out)
+{
+    std::unique_ptr<ExportedSchema> exported(new ExportedSchema());
+    exported->column = column;
+    exported->dictionary = 0;
+    try{
+        for (size_t i = 0; i < column->children.size(); ++i){
+            exported->children.push_back(0);
+            exported->children.back() = new ArrowSchema();
+            exportSchema(column->children[i], exported->children.back());
+        }
+        if (column->dictionary){
+            exported->dictionary = new ArrowSchema();
+            exportSchema(column->dictionary, exported->dictionary);
+        }
+    }catch (...){
+        for (size_t i = 0; i < exported->children.size(); ++i)
+            releaseChild(exported->children[i]);
+        releaseChild(exported->dictionary);
+        throw;
+    }
+
+    out->format = column->format.c_str();
+    out->name = column->name.c_str();
+    out->metadata = 0;
+    out->flags = column->flags;
+    out->n_children = exported->children.size();
+    out->children = exported->children.empty() ? 0 : &exported->children[0];
+    out->dictionary = exported->dictionary;
+    out->release = releaseSchema;
+    out->private_data = exported.release();
+}
+
+static void exportArray(const ArrowColumnPtr &column, ArrowArray *out)
+{
+    std::unique_ptr<ExportedArray> exported(new ExportedArray());
+    exported->column = column;
+    exported->dictionary = 0;
+    try{
+        for (size_t i = 0; i < column->children.size(); ++i){
+            exported->children.push_back(0);
+            exported->children.back() = new ArrowArray();
+            exportArray(column->children[i], exported->children.back());
+        }
+        if (column->dictionary){
+            exported->dictionary = new ArrowArray();
+            exportArray(column->dictionary, exported->dictionary);
+        }
+    }catch (...){
+        for (size_t i = 0; i < exported->children.size(); ++i)
+            releaseChild(exported->children[i]);
+        releaseChild(exported->dictionary);
+        throw;
+    }
+
+    out->length = column->length;
+    out->null_count = column->null_count;
+    out->offset = 0;
+    out->n_buffers = column->buffers.size();
+    out->n_children = exported->children.size();
+    out->buffers = column->buffers.empty() ? 0 : &column->buffers[0];
+    out->children = exported->children.empty() ? 0 : &exported->children[0];
+    out->dictionary = exported->dictionary;
+    out->release = releaseArray;
+    out->private_data = exported.release();
+}
+
+void ArrowBatch::exportSchema(ArrowSchema *out) const
+{
+    ::exportSchema(root, out);
+}
+
+void ArrowBatch::exportArray(ArrowArray *out) const
+{
+    ::exportArray(root, out);
+}
+
+/* Stream of a single batch */
+struct ExportedStream
+{
+    ArrowColumnPtr batch;
+    bool done;
+    stdString error;
+};
+
+static int getStreamSchema(ArrowArrayStream *stream, ArrowSchema *out)
+{
+    ExportedStream *exported = (ExportedStream *) stream->private_data;
+    try{
+        exportSchema(exported->batch, out);
+    }catch (std::bad_alloc &e){
+        exported->error = "Out of memory";
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static int getStreamNext(ArrowArrayStream *stream, ArrowArray *out)
+{
+    ExportedStream *exported = (ExportedStream *) stream->private_data;
+    if (exported->done){
+        out->release = 0; // end of stream
+        return 0;
+    }
+    try{
+        exportArray(exported->batch, out);
+    }catch (std::bad_alloc &e){
+        exported->error = "Out of memory";
+        return ENOMEM;
+    }
+    exported->done = true;
+    return 0;
+}
+
+static const char *getStreamError(ArrowArrayStream *stream)
+{
+    ExportedStream *exported = (ExportedStream *) stream->private_data;
+    return exported->error.empty() ? 0 : exported->error.c_str();
+}
+
+static void releaseStream(ArrowArrayStream *stream)
+{
+    delete (ExportedStream *) stream->private_data;
+    stream->release = 0;
+}
+
+void ArrowBatch::exportStream(ArrowArrayStream *out) const
+{
+    ExportedStream *exported = new ExportedStream();
+    exported->batch = root;
+    exported->done = false;
+
+    out->get_schema = getStreamSchema;
+    out->get_next = getStreamNext;
+    out->get_last_error = getStreamError;
+    out->release = releaseStream;
+    out->private_data = exported;
+}
@@ -0,0 +1,126 @@
+#ifndef _AE_ARROW_H_
+#define _AE_ARROW_H_
+
+// C++
+#include <memory>
+#include <stdint.h>
+
+#include "query.h"
+
+/*
+    Structs of the Arrow C data interface, see
+    https://arrow.apache.org/docs/format/CDataInterface.html
+    and https://arrow.apache.org/docs/format/CStreamInterface.html
+    They are ABI stable, so no arrow library is needed to fill them.
+*/
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    // Callbacks providing stream functionality
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+
+    // Release callback
+    void (*release)(struct ArrowArrayStream*);
+
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif  // ARROW_C_STREAM_INTERFACE
+
+struct ArrowColumn;
+
+/*
+    One segment of a channel as an Arrow record batch, with the columns
+        "timestamp"   ... timestamp[ns, UTC], nanoseconds since the Unix epoch
+        "value"       ... typed by the DBR type, a fixed size list if count > 1:
+                              DBR_TIME_STRING ... utf8
+                              DBR_TIME_CHAR   ... uint8
+                              DBR_TIME_ENUM   ... uint16
+                              DBR_TIME_SHORT  ... int16
+                              DBR_TIME_LONG   ... int32
+                              DBR_TIME_FLOAT  ... float
+                              DBR_TIME_DOUBLE ... double
+        "status"      ... uint16
+        "severity"    ... uint16
+        "enum_string" ... scalar enums only, dictionary<int32, utf8> of the CtrlInfo
+                          states, null if the value has no state string
+    The columns are filled once, every export references the same buffers, which
+    stay alive until the last exported struct is released.
+*/
+class ArrowBatch
+{
+public:
+    /*
+        Fills the columns from segment s of samples.
+        Throws GenericException for an unexpected DBR type.
+    */
+    ArrowBatch(const ChannelSamples &samples, size_t s);
+
+    /* Fills the columns of a batch without rows */
+    ArrowBatch(DbrType type, DbrCount count);
+
+    size_t size() const;
+
+    /*
+        Fill out with a new schema or array of the batch.
+        The consumer calls out->release when done.
+    */
+    void exportSchema(ArrowSchema *out) const;
+    void exportArray(ArrowArray *out) const;
+
+    /*
+        Fills out with a stream of this one batch.
+    */
+    void exportStream(ArrowArrayStream *out) const;
+
+private:
+    std::shared_ptr<ArrowColumn> root;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/* #define AE_DEBUG */
+
+/* C++ */
+#include <algorithm>
+
+/* Tools */
+#include <GenericException.h>
+
+#include "pool.h"
+
+TaskPool::TaskPool(size_t max_threads)
+    : max_threads(max_threads > 0 ? max_threads : 1), idle(0), quit(false)
+{}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        quit = true;
+        tasks.clear();
+    }
+    cond.notify_all();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+void TaskPool::submit(const std::function<void ()> &task)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    if (idle <= tasks.size() && threads.size() < max_threads){
+        // every idle thread is taken by a queued task already
+        try{
+            threads.push_back(std::thread(&TaskPool::threadMain, this));
+        }catch (std::exception &e){
+            if (threads.empty())
+                throw GenericException(__FILE__, __LINE__, "Cannot start worker thread: %s", e.what());
+            // else: the running threads get to it later
+        }
+    }
+    tasks.push_back(task);
+    cond.notify_one();
+}
+
+TaskPool &TaskPool::shared()
+{
+    static TaskPool pool(std::max<size_t>(4, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void TaskPool::threadMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        ++idle;
+        cond.wait(lock, [this](){ return quit || !tasks.empty(); });
+        --idle;
+        if (quit)
+            break;
+
+        std::function<void ()> task;
+        task.swap(tasks.front());
+        tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
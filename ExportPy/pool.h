@@ -0,0 +1,54 @@
+#ifndef _AE_POOL_H_
+#define _AE_POOL_H_
+
+// C++
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tools
+#include <NoCopy.h>
+
+/*
+    Native worker threads running tasks one after the other in the order they
+    were submitted, for the async queries. Tasks must not touch the Python API.
+    Threads are started on demand, up to max_threads.
+*/
+class TaskPool
+{
+public:
+    TaskPool(size_t max_threads);
+
+    /* Waits for the running tasks, queued tasks are dropped */
+    ~TaskPool();
+
+    /*
+        Queues task for the next free thread. task must not throw.
+        Throws GenericException if no thread could be started.
+    */
+    void submit(const std::function<void ()> &task);
+
+    /*
+        The pool shared by all async queries of the process, with
+        max(4, hardware concurrency) threads.
+    */
+    static TaskPool &shared();
+
+private:
+    PROHIBIT_DEFAULT_COPY(TaskPool);
+
+    void threadMain();
+
+    size_t max_threads;
+    std::mutex mutex; // protects the fields below
+    std::condition_variable cond;
+    std::deque<std::function<void ()> > tasks;
+    std::vector<std::thread> threads;
+    size_t idle; // threads waiting for a task
+    bool quit;
+};
+
+#endif
@@ -0,0 +1,671 @@
+/* #define AE_DEBUG */
+
+/* C++ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/* Tools */
+#include <AutoPtr.h>
+#include <GenericException.h>
+#include <RegularExpression.h>
+
+/* Storage */
+#include <DataFile.h>
+#include <IndexFile.h>
+#include <ReaderFactory.h>
+#include <RawValue.h>
+#include <RTree.h>
+
+#include "pool.h"
+#include "query.h"
+
+SampleSegment::SampleSegment(DbrType type, DbrCount count)
+    : type(type), count(count), raw_value_size(RawValue::getSize(type, count))
+{}
+
+size_t ChannelSamples::size() const {
+    size_t n = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
+        n += segments[i].size();
+    return n;
+}
+
+QueryControl::QueryControl()
+    : cancelled(false), owner(std::this_thread::get_id()),
+      last_poll(std::chrono::steady_clock::now()), samples(0)
+{}
+
+QueryControl::~QueryControl()
+{}
+
+void QueryControl::check() const
+{
+    if (cancelled.load(std::memory_order_relaxed))
+        throw QueryCancelled(__FILE__, __LINE__);
+}
+
+void QueryControl::advance(const stdString &channel_name, size_t samples, const epicsTime &time)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        this->samples += samples;
+        this->channel_name = channel_name;
+        this->time = time;
+    }
+    if (std::this_thread::get_id() == owner){
+        // poll() may have to wait for the GIL, don't do it for every report
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - last_poll >= std::chrono::milliseconds(poll_period_ms)){
+            last_poll = now;
+            poll();
+        }
+    }
+}
+
+size_t QueryControl::getProgress(stdString &channel_name, epicsTime &time) const
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    channel_name = this->channel_name;
+    time = this->time;
+    return samples;
+}
+
+void QueryControl::poll()
+{}
+
+void QueryControl::wait(std::unique_lock<std::mutex> &lock, std::condition_variable &cond,
+                        const std::function<bool ()> &done)
+{
+    while (!cond.wait_for(lock, std::chrono::milliseconds(poll_period_ms), done)){
+        lock.unlock();
+        poll();
+        lock.lock();
+    }
+}
+
+SampleCursor::SampleCursor(DataReader &reader, const stdString &channel_name,
+                           const epicsTime &start, const epicsTime &end, size_t limit,
+                           QueryControl *control)
+    : reader(reader), batches(reader), channel_name(channel_name), start(start), end(end),
+      limit(limit), control(control), count(0), reported(0), value(0), found(false)
+{}
+
+bool SampleCursor::read(ChannelSamples &samples, size_t max_samples)
+{
+    if (control)
+        control->check();
+    if (!found){
+        // let the reader stop at the last block needed, end is checked below anyway
+        reader.setBounds(end > epicsTime() ? &end : 0, limit);
+        // the binning readers start their bins at start if it is given
+        value = reader.find(channel_name, start > epicsTime() ? &start : 0);
+        batches.reset();
+        found = true;
+    }
+    size_t n = 0;
+    while (value && n < max_samples)
+    {
+        if (! RawValue::isInfo(value)){ // true here indicates a special record marking interruption in data recording
+            // the first sample of a chunk always gets the current info,
+            // changedInfo() also resets the flag left over from the previous channel
+            if (reader.changedInfo() || n == 0){
+                samples.infos.push_back(CtrlInfoSegment(samples.size(), reader.getInfo()));
+            }
+            if (samples.segments.empty() ||
+                samples.segments.back().type  != reader.getType() ||
+                samples.segments.back().count != reader.getCount()){
+                samples.segments.push_back(SampleSegment(reader.getType(), reader.getCount()));
+            }
+            samples.segments.back().append(value);
+            ++n;
+            ++count;
+            if (control && count - reported >= QueryControl::report_interval){
+                control->advance(channel_name, count - reported, RawValue::getTime(value));
+                reported = count;
+            }
+
+            // break one node after the end timestamp if end was set (is greater than 0)
+            if ((end > epicsTime() && RawValue::getTime(value) >= end) || count == limit){
+                value = 0;
+                break;
+            }
+        }
+        if (control)
+            control->check();
+        value = batches.next();
+    }
+    if (control && count > reported){
+        // report the rest, so the progress adds up to the samples read
+        const SampleSegment &last = samples.segments.back();
+        control->advance(channel_name, count - reported, RawValue::getTime(last.get(last.size() - 1)));
+        reported = count;
+    }
+    return value != 0;
+}
+
+void readChannelSamples(DataReader &reader, const stdString &channel_name,
+                        const epicsTime &start, const epicsTime &end,
+                        ChannelSamples &samples, size_t max_samples,
+                        QueryControl *control)
+{
+    SampleCursor cursor(reader, channel_name, start, end, max_samples, control);
+    cursor.read(samples, (size_t) -1);
+}
+
+/*
+    Collects the channel names matching pattern, or all if pattern is empty.
+    With entries, also remembers the NameHash entry of every match.
+*/
+static void scanChannels(Index &index, const stdString &pattern,
+                         std::vector<stdString> &channel_names, ScannedIndex::Entries *entries)
+{
+    AutoPtr<RegularExpression> regex;
+    if (pattern.length() > 0) {
+        regex.assign(new RegularExpression(pattern.c_str()));
+    }
+
+    Index::NameIterator name_iter;
+    if (!index.getFirstChannel(name_iter)) {
+        return; // no names found
+    }
+    do
+    {
+        if (regex && !regex->doesMatch(name_iter.getName()))
+            continue; // skip what doesn't match the regex
+        channel_names.push_back(name_iter.getName());
+        if (entries)
+            (*entries)[name_iter.getName()] = name_iter;
+    }
+    while (index.getNextChannel(name_iter));
+    // NC: getFirstChannel and getNextChannel is a pretty insane interface you have to deal with...
+}
+
+ScannedIndex::ScannedIndex(Index &index, const Entries &entries)
+    : index(index), entries(entries)
+{}
+
+void ScannedIndex::scan(const stdString &pattern, std::vector<stdString> &channel_names)
+{
+    entries.clear();
+    scanChannels(index, pattern, channel_names, &entries);
+}
+
+void ScannedIndex::open(const stdString &filename, bool readonly)
+{
+    index.open(filename, readonly);
+}
+
+void ScannedIndex::close()
+{
+    index.close();
+}
+
+RTree *ScannedIndex::addChannel(const stdString &channel, stdString &directory)
+{
+    return index.addChannel(channel, directory);
+}
+
+RTree *ScannedIndex::getTree(const stdString &channel, stdString &directory)
+{
+    Entries::const_iterator i = entries.find(channel);
+    if (i != entries.end())
+        return index.getTree(i->second, directory);
+    return index.getTree(channel, directory);
+}
+
+RTree *ScannedIndex::getTree(const NameIterator &iter, stdString &directory)
+{
+    return index.getTree(iter, directory);
+}
+
+bool ScannedIndex::getFirstChannel(NameIterator &iter)
+{
+    return index.getFirstChannel(iter);
+}
+
+bool ScannedIndex::getNextChannel(NameIterator &iter)
+{
+    return index.getNextChannel(iter);
+}
+
+/*
+    Reads channel_names[i] into samples[i] with one reader on index.
+*/
+static void readChannelsSerial(Index &index, const std::vector<stdString> &channel_names,
+                               const epicsTime &start, const epicsTime &end,
+                               std::vector<ChannelSamples> &samples,
+                               ReaderFactory::How how, double delta, size_t max_samples,
+                               QueryControl *control)
+{
+    AutoPtr<DataReader> reader(ReaderFactory::create(index, how, delta));
+
+    for (size_t i = 0; i < channel_names.size(); ++i){
+        readChannelSamples(*reader, channel_names[i], start, end, samples[i], max_samples, control);
+    }
+}
+
+/*
+    Counts the workers of a concurrent query running on the shared TaskPool. Shared with
+    the tasks still queued in the pool, since those may only start after the query returned.
+*/
+struct WorkerGroup
+{
+    WorkerGroup() : running(0), closed(false) {}
+
+    std::mutex mutex; // protects the fields below
+    std::condition_variable cond;
+    size_t running; // workers started and not done yet
+    bool closed;    // set once the query stops waiting, workers starting later do nothing
+};
+
+/* Handles channel i with the index and reader of one worker, see forChannelsConcurrently */
+typedef std::function<void (size_t i)> ChannelTask;
+
+/* Called once by every worker with its own index, returns the worker's ChannelTask */
+typedef std::function<ChannelTask (ScannedIndex &index)> WorkerSetup;
+
+/*
+    Runs the task for channels 0...channels-1 by threads workers. Each worker opens
+    its own index, resolving the channels in entries from their scanned entries
+    (see ScannedIndex), and gets its task from setup. Its data files are closed
+    when it is done. Rethrows the error of the first failing channel.
+
+    The calling thread is one of the workers, the others are tasks of the shared
+    TaskPool. Since the caller keeps working until all channels are handed out,
+    the query finishes even when every pool thread is busy, e.g. with async queries.
+    With control, the caller polls it while it waits for the other workers.
+*/
+static void forChannelsConcurrently(const stdString &index_name, const ScannedIndex::Entries &entries,
+                                    size_t channels, size_t threads, QueryControl *control,
+                                    const WorkerSetup &setup)
+{
+    std::vector<std::exception_ptr> errors(channels);
+    std::mutex errors_mutex;
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::function<void ()> work = [&](){
+        size_t i = 0;
+        try{
+            IndexFile index;
+            index.open(index_name, true);
+            ScannedIndex scanned(index, entries);
+
+            ChannelTask task = setup(scanned);
+            while (!failed && (i = next++) < channels){
+                task(i);
+            }
+        }catch (...){
+            // channel i failed, or the index could not be opened before handling channel i
+            std::lock_guard<std::mutex> guard(errors_mutex);
+            std::exception_ptr &error = errors[i < channels ? i : 0];
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+        // close the data files of this worker, in case no reader did
+        DataFile::clear_cache();
+    };
+
+    std::shared_ptr<WorkerGroup> group(new WorkerGroup());
+    try{
+        for (size_t t = 1; t < threads; ++t){
+            TaskPool::shared().submit([group, &work](){
+                {
+                    std::lock_guard<std::mutex> guard(group->mutex);
+                    if (group->closed)
+                        return; // the query is done, work is gone
+                    ++group->running;
+                }
+                work();
+                std::lock_guard<std::mutex> guard(group->mutex);
+                --group->running;
+                group->cond.notify_all();
+            });
+        }
+    }catch (std::exception &){
+        // the pool could not start any thread, the caller handles the remaining channels alone
+    }
+    work();
+
+    // all channels are handed out, wait for the workers still handling theirs
+    {
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->closed = true;
+        if (control)
+            control->wait(lock, group->cond, [&](){ return group->running == 0; });
+        else
+            group->cond.wait(lock, [&](){ return group->running == 0; });
+    }
+
+    // report the error of the first failing channel, like the serial loop would
+    for (size_t i = 0; i < errors.size(); ++i){
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+    }
+}
+
+/*
+    Reads channel_names[i] into samples[i] by threads workers with one reader each,
+    see forChannelsConcurrently.
+*/
+static void readChannelsConcurrently(const stdString &index_name, const ScannedIndex::Entries &entries,
+                                     const std::vector<stdString> &channel_names,
+                                     const epicsTime &start, const epicsTime &end,
+                                     std::vector<ChannelSamples> &samples,
+                                     ReaderFactory::How how, double delta, size_t threads, size_t max_samples,
+                                     QueryControl *control)
+{
+    forChannelsConcurrently(index_name, entries, channel_names.size(), threads, control,
+                            [&](ScannedIndex &index) -> ChannelTask {
+        std::shared_ptr<DataReader> reader(ReaderFactory::create(index, how, delta));
+        return [&, reader](size_t i){
+            readChannelSamples(*reader, channel_names[i], start, end, samples[i], max_samples, control);
+        };
+    });
+}
+
+void readChannels(const stdString &index_name, const std::vector<stdString> &channel_names,
+                  const epicsTime &start, const epicsTime &end,
+                  std::vector<ChannelSamples> &samples,
+                  ReaderFactory::How how, double delta, size_t threads, size_t max_samples,
+                  QueryControl *control)
+{
+    samples.resize(channel_names.size());
+
+    if (threads > channel_names.size())
+        threads = channel_names.size();
+
+    if (threads <= 1){
+        IndexFile index;
+        index.open(index_name, true);
+
+        readChannelsSerial(index, channel_names, start, end, samples, how, delta, max_samples, control);
+        return;
+    }
+    readChannelsConcurrently(index_name, ScannedIndex::Entries(), channel_names, start, end, samples,
+                             how, delta, threads, max_samples, control);
+}
+
+void readMatchingChannels(const stdString &index_name, const stdString &pattern,
+                          const epicsTime &start, const epicsTime &end,
+                          std::vector<stdString> &channel_names,
+                          std::vector<ChannelSamples> &samples,
+                          ReaderFactory::How how, double delta, size_t threads, size_t max_samples,
+                          QueryControl *control)
+{
+    IndexFile index;
+    index.open(index_name, true);
+
+    ScannedIndex scanned(index);
+    channel_names.clear();
+    scanned.scan(pattern, channel_names);
+    samples.resize(channel_names.size());
+
+    if (threads > channel_names.size())
+        threads = channel_names.size();
+
+    if (threads <= 1){
+        readChannelsSerial(scanned, channel_names, start, end, samples, how, delta, max_samples, control);
+        return;
+    }
+    readChannelsConcurrently(index_name, scanned.getEntries(), channel_names, start, end, samples,
+                             how, delta, threads, max_samples, control);
+}
+
+void readValuesAt(RawDataReader &reader, const stdString &channel_name,
+                  const std::vector<epicsTime> &times,
+                  ChannelSamples &samples, std::vector<bool> &valid)
+{
+    samples = ChannelSamples();
+    valid.assign(times.size(), false);
+    if (times.empty())
+        return;
+
+    std::vector<char> zero;
+    size_t pending = 0; // times without value before the first segment
+    reader.setBounds(0, 0); // the reader may be cached, clear bounds of earlier queries
+    const RawValue::Data *value = reader.find(channel_name, &times[0]);
+    for (size_t i = 0; i < times.size(); ++i)
+    {
+        if (i > 0 && value)
+            value = reader.seek(times[i]);
+        if (! value || RawValue::isInfo(value) || RawValue::getTime(value) > times[i])
+        {   // no value at this time, zero it in the current segment
+            if (samples.segments.empty())
+                ++pending;
+            else
+                samples.segments.back().append((const RawValue::Data *) &zero[0]);
+            continue;
+        }
+        if (reader.changedInfo() || samples.infos.empty()){
+            samples.infos.push_back(CtrlInfoSegment(samples.infos.empty() ? 0 : samples.size(), reader.getInfo()));
+        }
+        if (samples.segments.empty() ||
+            samples.segments.back().type  != reader.getType() ||
+            samples.segments.back().count != reader.getCount()){
+            samples.segments.push_back(SampleSegment(reader.getType(), reader.getCount()));
+            zero.assign(samples.segments.back().raw_value_size, 0);
+            for (; pending > 0; --pending)
+                samples.segments.back().append((const RawValue::Data *) &zero[0]);
+        }
+        samples.segments.back().append(value);
+        valid[i] = true;
+    }
+    if (pending > 0)
+    {   // no value at all
+        samples.infos.push_back(CtrlInfoSegment(0, CtrlInfo()));
+        samples.segments.push_back(SampleSegment(DBR_TIME_DOUBLE, 1));
+        zero.assign(samples.segments.back().raw_value_size, 0);
+        for (; pending > 0; --pending)
+            samples.segments.back().append((const RawValue::Data *) &zero[0]);
+    }
+}
+
+void readValuesAt(const stdString &index_name, const stdString &channel_name,
+                  const std::vector<epicsTime> &times,
+                  ChannelSamples &samples, std::vector<bool> &valid)
+{
+    IndexFile index;
+    index.open(index_name, true);
+
+    RawDataReader reader(index);
+    readValuesAt(reader, channel_name, times, samples, valid);
+}
+
+/*
+    Reads the header of a data block, referencing the data file like RawDataReader.
+*/
+static DataHeader *getDataHeader(const stdString &directory, const RTree::Datablock &block)
+{
+    DataFile *datafile;
+    if (block.data_filename[0] == '/') // Index gave us the data file with the full path
+        datafile = DataFile::reference("", block.data_filename, false);
+    else // Look relative to the index's directory
+        datafile = DataFile::reference(directory, block.data_filename, false);
+
+    DataHeader *header;
+    try{
+        header = datafile->getHeader(block.data_offset);
+    }catch (...){
+        datafile->release();
+        throw;
+    }
+    // DataFile now ref'ed by header
+    datafile->release();
+    return header;
+}
+
+void estimateChannel(Index &index, const stdString &channel_name,
+                     const epicsTime &start, const epicsTime &end,
+                     ChannelEstimate &estimate)
+{
+    estimate = ChannelEstimate();
+
+    stdString directory;
+    AutoPtr<RTree> tree(index.getTree(channel_name, directory));
+    if (!tree)
+        return; // Channel not found
+
+    bool has_start = start > epicsTime();
+    bool has_end = end > epicsTime();
+    RTree::Node node(tree->getM(), true);
+    RTree::Datablock block;
+    int i;
+    bool valid = has_start ? tree->searchDatablock(start, node, i, block)
+                           : tree->getFirstDatablock(node, i, block);
+    double samples = 0.0, bytes = 0.0;
+    while (valid)
+    {
+        const epicsTime &block_start = node.record[i].start;
+        const epicsTime &block_end = node.record[i].end;
+        if (has_end && block_start > end)
+            break;
+
+        AutoPtr<DataHeader> header(getDataHeader(directory, block));
+        double num_samples = header->data.num_samples;
+
+        // part of the block within start...end, assuming evenly spread samples
+        double duration = block_end - block_start;
+        if (duration > 0.0){
+            double from = has_start && start > block_start ? start - block_start : 0.0;
+            double to = has_end && end < block_end ? end - block_start : duration;
+            if (to > from)
+                num_samples *= (to - from) / duration;
+            else
+                num_samples = 0.0;
+        }
+        // the sample before-or-at start and the one at-or-after end are returned, too
+        if (num_samples < 1.0 && header->data.num_samples > 0)
+            num_samples = 1.0;
+
+        ++estimate.blocks;
+        samples += num_samples;
+        bytes += num_samples * RawValue::getSize(header->data.dbr_type, header->data.dbr_count);
+
+        valid = tree->getNextDatablock(node, i, block);
+    }
+    estimate.samples = (size_t) (samples + 0.5);
+    estimate.bytes = (size_t) (bytes + 0.5);
+}
+
+void estimateChannels(const stdString &index_name, const std::vector<stdString> &channel_names,
+                      const epicsTime &start, const epicsTime &end,
+                      std::vector<ChannelEstimate> &estimates)
+{
+    IndexFile index;
+    index.open(index_name, true);
+
+    estimates.resize(channel_names.size());
+    try{
+        for (size_t i = 0; i < channel_names.size(); ++i){
+            estimateChannel(index, channel_names[i], start, end, estimates[i]);
+        }
+    }catch (...){
+        DataFile::clear_cache();
+        throw;
+    }
+    // close the data files, there is no reader to do it
+    DataFile::clear_cache();
+}
+
+/*
+    Duration of data block i of node in seconds, 0 if it has none.
+*/
+static double getBlockSpan(const RTree::Node &node, int i)
+{
+    double duration = node.record[i].end - node.record[i].start;
+    return duration > 0.0 ? duration : 0.0;
+}
+
+void catalogChannel(Index &index, const stdString &channel_name, ChannelCatalog &catalog)
+{
+    catalog = ChannelCatalog();
+
+    stdString directory;
+    AutoPtr<RTree> tree(index.getTree(channel_name, directory));
+    if (!tree || !tree->getInterval(catalog.first, catalog.last))
+        return; // Channel not found or empty
+
+    RTree::Node first_node(tree->getM(), true), last_node(tree->getM(), true);
+    RTree::Datablock first_block, last_block;
+    int first_i, last_i;
+    if (!tree->getFirstDatablock(first_node, first_i, first_block) ||
+        !tree->getLastDatablock(last_node, last_i, last_block))
+        return;
+
+    AutoPtr<DataHeader> last(getDataHeader(directory, last_block));
+    catalog.valid = true;
+    catalog.type = last->data.dbr_type;
+    catalog.count = last->data.dbr_count;
+    if (first_block.data_offset == last_block.data_offset &&
+        first_block.data_filename == last_block.data_filename){
+        catalog.samples = last->data.num_samples;
+        return;
+    }
+    AutoPtr<DataHeader> first(getDataHeader(directory, first_block));
+    double samples = (double) first->data.num_samples + last->data.num_samples;
+    double span = getBlockSpan(first_node, first_i) + getBlockSpan(last_node, last_i);
+    double duration = catalog.last - catalog.first;
+    // the blocks in between at the rate of the first and the last one
+    if (span > 0.0 && duration > span)
+        samples *= duration / span;
+    catalog.samples = (size_t) (samples + 0.5);
+}
+
+void catalogChannels(const stdString &index_name, const stdString &pattern,
+                     std::vector<stdString> &channel_names,
+                     std::vector<ChannelCatalog> &catalogs, size_t threads)
+{
+    IndexFile index;
+    index.open(index_name, true);
+
+    ScannedIndex scanned(index);
+    channel_names.clear();
+    scanned.scan(pattern, channel_names);
+    catalogs.clear();
+    catalogs.resize(channel_names.size());
+
+    if (threads > channel_names.size())
+        threads = channel_names.size();
+
+    if (threads <= 1){
+        try{
+            for (size_t i = 0; i < channel_names.size(); ++i){
+                catalogChannel(scanned, channel_names[i], catalogs[i]);
+            }
+        }catch (...){
+            DataFile::clear_cache();
+            throw;
+        }
+        DataFile::clear_cache();
+        return;
+    }
+
+    forChannelsConcurrently(index_name, scanned.getEntries(), channel_names.size(), threads, 0,
+                            [&](ScannedIndex &index) -> ChannelTask {
+        return [&](size_t i){
+            catalogChannel(index, channel_names[i], catalogs[i]);
+        };
+    });
+}
+
+void listChannels(const stdString &index_name, const stdString &pattern,
+                  std::vector<stdString> &channel_names)
+{
+    IndexFile index;
+    index.open(index_name, true);
+
+    listChannels(index, pattern, channel_names);
+}
+
+void listChannels(Index &index, const stdString &pattern,
+                  std::vector<stdString> &channel_names)
+{
+    scanChannels(index, pattern, channel_names, 0);
+}
@@ -0,0 +1,399 @@
+#ifndef _AE_QUERY_H_
+#define _AE_QUERY_H_
+
+// C++
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tools
+#include <GenericException.h>
+#include <NoCopy.h>
+#include <stdString.h>
+
+// Storage
+#include <Index.h>
+#include <DataReader.h>
+#include <RawDataReader.h>
+#include <ReaderFactory.h>
+#include <CtrlInfo.h>
+#include <RawValue.h>
+
+/*
+    Native part of the queries. Nothing in here touches the Python API, so it runs
+    with the GIL released. The results are converted to Python objects afterwards,
+    see utils.h.
+*/
+
+/*
+    Samples of one channel that share the same DBR type and count, stored as decoded
+    RawValue::Data records (host byte order) one after the other.
+*/
+struct SampleSegment
+{
+    SampleSegment(DbrType type, DbrCount count);
+
+    DbrType  type;
+    DbrCount count;
+    size_t   raw_value_size; // RawValue::getSize(type, count)
+    std::vector<char> raw;
+
+    size_t size() const { return raw.size() / raw_value_size; }
+
+    const RawValue::Data *get(size_t i) const
+    {   return (const RawValue::Data *) &raw[i * raw_value_size]; }
+
+    void append(const RawValue::Data *value)
+    {   raw.insert(raw.end(), (const char *) value, (const char *) value + raw_value_size); }
+};
+
+/*
+    Time stamp of value in nanoseconds since the Unix epoch, shifted from the
+    EPICS epoch (1990).
+*/
+inline int64_t getUnixNanoseconds(const RawValue::Data *value)
+{
+    return ((int64_t) value->stamp.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH) * 1000000000
+           + value->stamp.nsec;
+}
+
+/*
+    CtrlInfo valid for all samples of a channel from sample index 'first' on,
+    until the next CtrlInfoSegment. Sample indices count over all segments.
+*/
+struct CtrlInfoSegment
+{
+    CtrlInfoSegment(size_t first, const CtrlInfo &info) : first(first), info(info) {}
+
+    size_t   first;
+    CtrlInfo info;
+};
+
+/*
+    All samples read for one channel. A new segment is started whenever the DBR type
+    or count of the channel changes within the requested time range.
+*/
+struct ChannelSamples
+{
+    std::vector<SampleSegment>   segments;
+    std::vector<CtrlInfoSegment> infos;
+
+    size_t size() const;
+};
+
+/*
+    Lets another thread stop a running query: the readers check cancelled before
+    every sample and throw QueryCancelled once it is set.
+
+    The readers also report their progress every report_interval samples, see
+    advance(). The thread that created the control gets to poll() while the query
+    runs, e.g. to check for signals and call a progress callback, about every
+    poll_period_ms: from advance() while it reads channels itself, else while it
+    waits for the threads reading them, see wait().
+*/
+struct QueryControl
+{
+    QueryControl();
+    virtual ~QueryControl();
+
+    std::atomic<bool> cancelled;
+
+    /* Throws QueryCancelled if cancelled is set */
+    void check() const;
+
+    /* Samples a reader reads between two calls of advance() */
+    static const size_t report_interval = 1024;
+
+    /*
+        Longest time wait() goes without calling poll(),
+        and shortest time between two calls of poll() from advance()
+    */
+    static const int poll_period_ms = 50;
+
+    /*
+        Called by the readers with the number of samples read since the last call,
+        and the time of the last one. Adds them to the progress, and calls poll()
+        when called by the thread that created the control and poll_period_ms
+        have passed since the last time it did.
+    */
+    void advance(const stdString &channel_name, size_t samples, const epicsTime &time);
+
+    /*
+        Returns the number of samples read by the query so far. channel_name and
+        time get the channel and time of the last progress report.
+    */
+    size_t getProgress(stdString &channel_name, epicsTime &time) const;
+
+    /*
+        Called by the thread that created the control while the query runs.
+        Sets cancelled to stop the query, must not throw.
+        The default does nothing.
+    */
+    virtual void poll();
+
+    /*
+        Waits on cond until done() returns true, like cond.wait(lock, done),
+        calling poll() with lock released at least every poll_period_ms.
+    */
+    void wait(std::unique_lock<std::mutex> &lock, std::condition_variable &cond,
+              const std::function<bool ()> &done);
+
+private:
+    PROHIBIT_DEFAULT_COPY(QueryControl);
+
+    std::thread::id owner;
+    std::chrono::steady_clock::time_point last_poll; // by advance(), only used by owner
+    mutable std::mutex mutex; // protects the progress below
+    size_t samples;
+    stdString channel_name;
+    epicsTime time;
+};
+
+/* Thrown by a query that was cancelled through its QueryControl */
+class QueryCancelled : public GenericException
+{
+public:
+    QueryCancelled(const char *sourcefile, size_t line)
+        : GenericException(sourcefile, line, "Query cancelled.")
+    {}
+};
+
+/*
+    Reads samples of a channel in chunks, keeping the reader position in between.
+    The samples are the same as with readChannelSamples, every chunk starts with
+    the CtrlInfo valid for its first sample.
+    The reader must not be used for anything else until the last chunk is read.
+    With limit > 0 at most limit samples are read in total. With control
+    the cursor stops with QueryCancelled once the query is cancelled, and
+    reports its progress to it.
+*/
+class SampleCursor
+{
+public:
+    SampleCursor(DataReader &reader, const stdString &channel_name,
+                 const epicsTime &start, const epicsTime &end, size_t limit = 0,
+                 QueryControl *control = 0);
+
+    /*
+        Appends at most max_samples samples to samples.
+        Returns false if there are no more samples to read.
+        Throws GenericException on error.
+    */
+    bool read(ChannelSamples &samples, size_t max_samples);
+
+private:
+    PROHIBIT_DEFAULT_COPY(SampleCursor);
+
+    DataReader &reader;
+    DataBatchIterator batches; // reads the samples after the first one
+    stdString channel_name;
+    epicsTime start;
+    epicsTime end;
+    size_t limit;
+    QueryControl *control;
+    size_t count; // samples read so far
+    size_t reported; // samples reported to control so far
+    const RawValue::Data *value; // next sample, 0 at the end
+    bool found;
+};
+
+/*
+    Index that finds channels by pattern and then reads them without looking
+    each name up again: scan() remembers the NameHash entries of the matches,
+    getTree() of a remembered channel uses its entry (see Index::getTree).
+    Everything else is passed on to the wrapped index.
+*/
+class ScannedIndex : public Index
+{
+public:
+    typedef std::map<stdString, Index::NameIterator> Entries;
+
+    ScannedIndex(Index &index, const Entries &entries = Entries());
+
+    /*
+        Collects the channel names matching the regular expression pattern in one
+        pass over the names, like listChannels, and remembers their entries
+        instead of the ones of an earlier scan.
+        Throws GenericException on error.
+    */
+    void scan(const stdString &pattern, std::vector<stdString> &channel_names);
+
+    const Entries &getEntries() const { return entries; }
+
+    void open(const stdString &filename, bool readonly=true);
+    void close();
+    class RTree *addChannel(const stdString &channel, stdString &directory);
+    class RTree *getTree(const stdString &channel, stdString &directory);
+    class RTree *getTree(const NameIterator &iter, stdString &directory);
+    bool getFirstChannel(NameIterator &iter);
+    bool getNextChannel(NameIterator &iter);
+
+private:
+    PROHIBIT_DEFAULT_COPY(ScannedIndex);
+
+    Index &index;
+    Entries entries;
+};
+
+/*
+    Reads samples of a channel the way get_data() returns them: one sample
+    before-or-at start, everything in between and one sample at-or-after end
+    (if end is set). Special records marking interruptions in data recording
+    are skipped. With max_samples > 0 only the first max_samples samples are read.
+    end and max_samples are passed on to the reader (see DataReader::setBounds),
+    so it stops at the last data block needed.
+    control lets another thread cancel the read and follow its progress,
+    see QueryControl.
+    Throws GenericException on error.
+*/
+void readChannelSamples(DataReader &reader, const stdString &channel_name,
+                        const epicsTime &start, const epicsTime &end,
+                        ChannelSamples &samples, size_t max_samples = 0,
+                        QueryControl *control = 0);
+
+/*
+    Opens the index in readonly mode and reads all channels, see readChannelSamples.
+    samples gets one entry per channel name, in the same order.
+    how and delta select the reader, see ReaderFactory: the binning readers
+    return one or a few samples per delta seconds instead of the raw samples.
+    max_samples > 0 limits the samples read per channel.
+    With threads > 1 the channels are read concurrently by that many workers,
+    each with its own index, reader and data file handles: the calling thread and
+    threads - 1 tasks of the shared TaskPool. The result is the same as with a single thread.
+    Throws GenericException on error.
+*/
+void readChannels(const stdString &index_name, const std::vector<stdString> &channel_names,
+                  const epicsTime &start, const epicsTime &end,
+                  std::vector<ChannelSamples> &samples,
+                  ReaderFactory::How how = ReaderFactory::Raw, double delta = 0.0,
+                  size_t threads = 1, size_t max_samples = 0,
+                  QueryControl *control = 0);
+
+/*
+    Same as above for the channels matching the regular expression pattern,
+    which are found and read in one pass over the index: the matches are read
+    through a ScannedIndex, so their names are not looked up a second time.
+    channel_names gets the matching names, samples one entry per name.
+    Throws GenericException on error.
+*/
+void readMatchingChannels(const stdString &index_name, const stdString &pattern,
+                          const epicsTime &start, const epicsTime &end,
+                          std::vector<stdString> &channel_names,
+                          std::vector<ChannelSamples> &samples,
+                          ReaderFactory::How how = ReaderFactory::Raw, double delta = 0.0,
+                          size_t threads = 1, size_t max_samples = 0,
+                          QueryControl *control = 0);
+
+/*
+    Reads the value the channel had at each of the times (sample-and-hold): the
+    last sample before-or-at the time. times must be sorted. The reader moves
+    forward with RawDataReader::seek, searching only the current data block
+    as long as the times stay within it.
+    samples gets one sample per time, in the same order. valid[i] is false if
+    the channel had no value at times[i], because it is before the first sample
+    or archiving was off; that sample is zeroed.
+    Throws GenericException on error.
+*/
+void readValuesAt(RawDataReader &reader, const stdString &channel_name,
+                  const std::vector<epicsTime> &times,
+                  ChannelSamples &samples, std::vector<bool> &valid);
+
+/*
+    Same as above, opening the index in readonly mode.
+*/
+void readValuesAt(const stdString &index_name, const stdString &channel_name,
+                  const std::vector<epicsTime> &times,
+                  ChannelSamples &samples, std::vector<bool> &valid);
+
+/*
+    Estimated size of a query for one channel, see estimateChannel.
+*/
+struct ChannelEstimate
+{
+    ChannelEstimate() : blocks(0), samples(0), bytes(0) {}
+
+    size_t blocks;   // data blocks touched by the query
+    size_t samples;  // estimated number of samples
+    size_t bytes;    // estimated size of the decoded samples (RawValue::getSize)
+};
+
+/*
+    Estimates how many samples readChannelSamples would return, without reading
+    any samples: walks the RTree of the channel from start to end and reads only
+    the DataHeader of every data block. Blocks that are only partly within
+    start...end are counted in proportion to the overlap of their time range.
+    A channel that is not found is estimated as empty.
+    Throws GenericException on error.
+*/
+void estimateChannel(Index &index, const stdString &channel_name,
+                     const epicsTime &start, const epicsTime &end,
+                     ChannelEstimate &estimate);
+
+/*
+    Opens the index in readonly mode and estimates all channels, see estimateChannel.
+    estimates gets one entry per channel name, in the same order.
+    Throws GenericException on error.
+*/
+void estimateChannels(const stdString &index_name, const std::vector<stdString> &channel_names,
+                      const epicsTime &start, const epicsTime &end,
+                      std::vector<ChannelEstimate> &estimates);
+
+/*
+    What the index and the data block headers tell about a channel, see catalogChannel.
+*/
+struct ChannelCatalog
+{
+    ChannelCatalog() : valid(false), type(0), count(0), samples(0) {}
+
+    bool valid;        // false if the channel has no data blocks
+    epicsTime first;   // start of the time range covered by the channel, see RTree::getInterval
+    epicsTime last;    // end of that time range
+    DbrType type;      // dbr_time_xxx type of the last data block
+    DbrCount count;    // array size of the last data block
+    size_t samples;    // estimated number of samples
+};
+
+/*
+    Catalogs a channel without reading any samples: the time range comes from
+    the root of its RTree, type and count from the header of the last data block.
+    samples is extrapolated over the time range from the sample rate of the first
+    and the last data block, it is exact for a channel with a single block.
+    A channel that is not found or has no data blocks is not valid.
+    Throws GenericException on error.
+*/
+void catalogChannel(Index &index, const stdString &channel_name, ChannelCatalog &catalog);
+
+/*
+    Opens the index in readonly mode and catalogs all channels matching the regular
+    expression pattern, or all channels if pattern is empty. The matches are found
+    in one pass over the names and catalogued from their scanned entries, see ScannedIndex.
+    channel_names gets the matching names, catalogs one entry per name.
+    With threads > 1 the channels are catalogued by that many workers as in
+    readChannels, each with its own index and data file handles.
+    Throws GenericException on error.
+*/
+void catalogChannels(const stdString &index_name, const stdString &pattern,
+                     std::vector<stdString> &channel_names,
+                     std::vector<ChannelCatalog> &catalogs, size_t threads = 1);
+
+/*
+    Opens the index in readonly mode and collects all channel names matching the
+    regular expression pattern, or all channel names if pattern is empty.
+    Throws GenericException on error.
+*/
+void listChannels(const stdString &index_name, const stdString &pattern,
+                  std::vector<stdString> &channel_names);
+
+/*
+    Same as above for an index that is already open.
+*/
+void listChannels(Index &index, const stdString &pattern,
+                  std::vector<stdString> &channel_names);
+
+#endif
@@ -0,0 +1,173 @@
+/* #define AE_DEBUG */
+
+/* C, C++ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+/* Tools */
+#include <GenericException.h>
+
+/* Storage */
+#include <RawValue.h>
+
+#include "shm.h"
+
+static const size_t column_alignment = 64;
+
+/* counts the objects created by this process, for unique names */
+static std::atomic<unsigned> shm_counter(0);
+
+static size_t
+alignColumn(size_t offset)
+{
+    return (offset + column_alignment - 1) / column_alignment * column_alignment;
+}
+
+/*
+    Places the columns of segment from offset on, with a time column instead of
+    seconds and nanoseconds if unix_time is set.
+    Returns the offset after the last column.
+*/
+static size_t
+layoutSegment(ShmSegment &segment, size_t offset, bool unix_time)
+{
+    segment.value       = alignColumn(offset);
+    offset = segment.value + segment.size * dbr_value_size[segment.type] * segment.count;
+    if (unix_time){
+        segment.seconds     = 0;
+        segment.nanoseconds = 0;
+        segment.time        = alignColumn(offset);
+        offset = segment.time + segment.size * sizeof(int64_t);
+    }else{
+        segment.seconds     = alignColumn(offset);
+        segment.nanoseconds = alignColumn(segment.seconds + segment.size * sizeof(int64_t));
+        segment.time        = 0;
+        offset = segment.nanoseconds + segment.size * sizeof(int64_t);
+    }
+    segment.status      = alignColumn(offset);
+    segment.severity    = alignColumn(segment.status + segment.size * sizeof(uint16_t));
+    return segment.severity + segment.size * sizeof(uint16_t);
+}
+
+static void
+addSegment(std::vector<ShmSegment> &segments, DbrType type, DbrCount count, size_t size, size_t &offset,
+           bool unix_time)
+{
+    ShmSegment segment;
+    segment.type = type;
+    segment.count = count;
+    segment.size = size;
+    offset = layoutSegment(segment, offset, unix_time);
+    segments.push_back(segment);
+}
+
+/*
+    Copies the samples of segment into the columns of shm_segment, base being
+    the start of the mapped object. unix_time as for layoutSegment.
+*/
+static void
+fillSegment(char *base, const ShmSegment &shm_segment, const SampleSegment &segment, bool unix_time)
+{
+    size_t value_size = dbr_value_size[segment.type] * segment.count;
+    char     *value       = base + shm_segment.value;
+    int64_t  *seconds     = (int64_t *) (base + shm_segment.seconds);
+    int64_t  *nanoseconds = (int64_t *) (base + shm_segment.nanoseconds);
+    int64_t  *time        = (int64_t *) (base + shm_segment.time);
+    uint16_t *status      = (uint16_t *) (base + shm_segment.status);
+    uint16_t *severity    = (uint16_t *) (base + shm_segment.severity);
+
+    for (size_t i = 0; i < segment.size(); ++i){
+        const RawValue::Data *data = segment.get(i);
+        memcpy(value + i * value_size, dbr_value_ptr(data, segment.type), value_size);
+        if (unix_time){
+            time[i]        = getUnixNanoseconds(data);
+        }else{
+            seconds[i]     = data->stamp.secPastEpoch;
+            nanoseconds[i] = data->stamp.nsec;
+        }
+        status[i]      = data->status;
+        severity[i]    = data->severity;
+    }
+}
+
+/*
+    Creates a new shared memory object of size bytes with a name not used yet.
+    Sets name and returns the file descriptor.
+*/
+static int
+createSharedMemory(stdString &name, size_t size)
+{
+    char path[64];
+    for (int attempt = 0; attempt < 100; ++attempt){
+        snprintf(path, sizeof(path), "/ae_%ld_%u", (long) getpid(), shm_counter++);
+        int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0){
+            if (errno == EEXIST)
+                continue; // left over by an earlier process with the same pid
+            throw GenericException(__FILE__, __LINE__, "Cannot create shared memory '%s': %s",
+                                   path, strerror(errno));
+        }
+        if (ftruncate(fd, size) != 0){
+            int error = errno;
+            close(fd);
+            shm_unlink(path);
+            throw GenericException(__FILE__, __LINE__, "Cannot resize shared memory '%s' to %zu bytes: %s",
+                                   path, size, strerror(error));
+        }
+        name = path + 1;
+        return fd;
+    }
+    throw GenericException(__FILE__, __LINE__, "Cannot find a free shared memory name");
+}
+
+void writeSharedMemory(const std::vector<ChannelSamples> &samples, ShmResult &result, bool unix_time)
+{
+    // lay out all columns first, so the object is created with its final size
+    size_t offset = 0;
+    result.channels.clear();
+    result.channels.resize(samples.size());
+    for (size_t c = 0; c < samples.size(); ++c){
+        const ChannelSamples &channel = samples[c];
+        if (channel.segments.empty()){
+            // no samples, type is unknown
+            addSegment(result.channels[c], DBR_TIME_DOUBLE, 1, 0, offset, unix_time);
+        }
+        for (size_t s = 0; s < channel.segments.size(); ++s){
+            const SampleSegment &segment = channel.segments[s];
+            addSegment(result.channels[c], segment.type, segment.count, segment.size(), offset, unix_time);
+        }
+    }
+    // an empty object cannot be mapped
+    result.size = offset > 0 ? offset : 1;
+
+    int fd = createSharedMemory(result.name, result.size);
+    void *base = mmap(0, result.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (base == MAP_FAILED){
+        unlinkSharedMemory(result.name);
+        throw GenericException(__FILE__, __LINE__, "Cannot map shared memory '%s': %s",
+                               result.name.c_str(), strerror(error));
+    }
+
+    for (size_t c = 0; c < samples.size(); ++c){
+        for (size_t s = 0; s < samples[c].segments.size(); ++s){
+            fillSegment((char *) base, result.channels[c][s], samples[c].segments[s], unix_time);
+        }
+    }
+    munmap(base, result.size);
+}
+
+void unlinkSharedMemory(const stdString &name)
+{
+    stdString path("/");
+    path += name;
+    shm_unlink(path.c_str());
+}
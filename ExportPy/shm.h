@@ -0,0 +1,67 @@
+#ifndef _AE_SHM_H_
+#define _AE_SHM_H_
+
+// C++
+#include <vector>
+
+// Tools
+#include <stdString.h>
+
+#include "query.h"
+
+/*
+    Columns of one SampleSegment in a shared memory result, given as byte offsets
+    into the object. Every column holds one element per sample, "value" holds
+    count elements per sample:
+        value       ... DBR value type, see NumpyDtype_FromDBRType
+        seconds     ... int64, seconds past since Epics epoch
+        nanoseconds ... int64
+        time        ... int64, nanoseconds since the Unix epoch, instead of
+                        seconds and nanoseconds (see writeSharedMemory)
+        status      ... uint16
+        severity    ... uint16
+    Columns are 64 byte aligned. Columns that are not written have offset 0.
+*/
+struct ShmSegment
+{
+    DbrType  type;
+    DbrCount count;
+    size_t   size;  // number of samples
+    size_t   value;
+    size_t   seconds;
+    size_t   nanoseconds;
+    size_t   time;
+    size_t   status;
+    size_t   severity;
+};
+
+/*
+    A POSIX shared memory object holding the samples of all channels of a query.
+*/
+struct ShmResult
+{
+    ShmResult() : size(0) {}
+
+    stdString name;  // without the leading '/', as multiprocessing.shared_memory takes it
+    size_t    size;  // in bytes
+    std::vector<std::vector<ShmSegment> > channels;  // segments of each channel
+};
+
+/*
+    Creates a new shared memory object and writes the samples of all channels into
+    it column by column, decoded straight from the RawValue::Data records. A channel
+    without samples gets one empty DBR_TIME_DOUBLE segment.
+    With unix_time the time stamps are written to the time column, else to
+    the seconds and nanoseconds columns.
+    The object stays until the consumer unlinks it, or unlinkSharedMemory is called.
+    Throws GenericException on error.
+*/
+void writeSharedMemory(const std::vector<ChannelSamples> &samples, ShmResult &result,
+                       bool unix_time = false);
+
+/*
+    Removes a shared memory object created by writeSharedMemory, ignoring errors.
+*/
+void unlinkSharedMemory(const stdString &name);
+
+#endif
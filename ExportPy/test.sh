@@ -0,0 +1,11 @@
+#!/bin/sh
+# Builds the module, writes the test index into test/data
+# and runs the Python tests against it.
+
+make || exit 1
+rm -rf test/data
+mkdir -p test/data
+cp O.$EPICS_HOST_ARCH/libarchiveexport.so test/data/archiveexport.so || exit 1
+cd test/data
+../../O.$EPICS_HOST_ARCH/TestIndex || exit 1
+PYTHONPATH=. python3 ../test_archiveexport.py index
@@ -0,0 +1,160 @@
+"""
+Tests of the archiveexport module against the index written by TestIndex, see test.sh:
+
+    python3 test/test_archiveexport.py [-v] [index]
+
+index defaults to "index" in the current directory.
+"""
+import archiveexport as ae
+import datetime
+import os
+import sys
+import unittest
+
+INDEX = "index"
+# time of the first sample of every channel, see TestIndex.cpp
+TEST_START = datetime.datetime.fromtimestamp(631152000 + 1000000000)
+START = TEST_START - datetime.timedelta(seconds=1)
+END = TEST_START + datetime.timedelta(minutes=1)
+CHANNELS = ["CH:{:02d}".format(c) for c in range(40)]
+# readers an Archive keeps open, see Archive::max_readers
+MAX_READERS = 16
+
+
+def open_fds():
+    return len(os.listdir("/proc/self/fd"))
+
+
+class StatusTest(unittest.TestCase):
+
+    # status, status string, severity and severity string of the samples of "ALARM" in TestIndex.cpp
+    ALARMS = [(0, "NO_ALARM", 0, "NO_ALARM"), (4, "HIGH", 1, "MINOR"), (3, "HIHI", 2, "MAJOR"), (5, "LOLO", 2, "MAJOR")]
+
+    def alarms(self, rows):
+        return [(row["status"], row["status_string"], row["severity"], row["severity_string"]) for row in rows]
+
+    def test_severity_string(self):
+        # the severity string is looked up by the severity, not by the status
+        data = ae.get_data(index_name=INDEX, channels=["ALARM"], start=START, end=END, get_status=True)
+        self.assertEqual(self.alarms(data["ALARM"]), self.ALARMS)
+        data = ae.get_data(index_name=INDEX, channels=["ALARM"], start=START, end=END, get_status=True,
+                           layout="segments")
+        self.assertEqual(self.alarms(data["ALARM"]["samples"]), self.ALARMS)
+
+    def test_string_tables(self):
+        for status, status_string, severity, severity_string in self.ALARMS:
+            self.assertEqual(ae.STATUS_STRINGS[status], status_string)
+            self.assertEqual(ae.SEVERITY_STRINGS[severity], severity_string)
+
+
+class InfoTest(unittest.TestCase):
+
+    def test_limit_keys(self):
+        # limits of TestIndex.cpp
+        limits = {"low_alarm": -9.0, "low_warn": -8.0, "high_warn": 8.0, "high_alarm": 9.0,
+                  "disp_low": -10.0, "disp_high": 10.0, "precision": 2}
+        data = ae.get_data(index_name=INDEX, channels=["ALARM"], start=START, end=END, get_info=True,
+                           layout="segments")
+        info = data["ALARM"]["info"][0]
+        self.assertEqual({key: info[key] for key in limits}, limits)
+
+        # the rows keep the historical swap of high_warn and high_alarm
+        limits["high_warn"], limits["high_alarm"] = limits["high_alarm"], limits["high_warn"]
+        data = ae.get_data(index_name=INDEX, channels=["ALARM"], start=START, end=END, get_info=True)
+        for row in data["ALARM"]:
+            self.assertEqual({key: row[key] for key in limits}, limits)
+
+
+def run_in_subinterpreter(script, isolated=False):
+    """Runs script in a new subinterpreter, returns its error message or None."""
+    try:
+        import _interpreters  # Python 3.13+
+        interp = _interpreters.create("isolated" if isolated else "legacy")
+        try:
+            error = _interpreters.run_string(interp, script)
+            return None if error is None else error.formatted
+        finally:
+            _interpreters.destroy(interp)
+    except ImportError:
+        import _xxsubinterpreters as interpreters
+    interp = interpreters.create(isolated=isolated)
+    try:
+        interpreters.run_string(interp, script)
+        return None
+    except interpreters.RunFailedError as e:
+        return str(e)
+    finally:
+        interpreters.destroy(interp)
+
+
+SUBINTERPRETER_SCRIPT = """
+import sys
+sys.path[:] = {path!r}
+import archiveexport as ae
+import datetime
+
+start = datetime.datetime.fromtimestamp({start!r})
+end = start + datetime.timedelta(seconds=10)
+data = ae.get_data(index_name={index!r}, channels=["CH:00"], start=start, end=end)
+assert [row["value"] for row in data["CH:00"]] == list(range(10)), data
+
+# an aware datetime goes through the datetime C API too
+start = datetime.datetime.fromtimestamp({start!r}, datetime.timezone.utc) + datetime.timedelta(seconds=5)
+data = ae.get_data(index_name={index!r}, channels=["CH:00"], start=start, end=end)
+assert [row["value"] for row in data["CH:00"]] == list(range(5, 10)), data
+
+catalog = ae.catalog(index_name={index!r}, pattern="CH:00")
+assert catalog["CH:00"]["first"] == datetime.datetime.fromtimestamp({start!r}), catalog
+"""
+
+
+@unittest.skipUnless(sys.version_info >= (3, 9), "the module can be loaded in one interpreter only")
+class SubinterpreterTest(unittest.TestCase):
+
+    def script(self):
+        return SUBINTERPRETER_SCRIPT.format(path=sys.path, start=TEST_START.timestamp(),
+                                            index=os.path.abspath(INDEX))
+
+    def test_get_data(self):
+        # the module was imported by the main interpreter already
+        self.assertIsNone(run_in_subinterpreter(self.script()))
+        self.assertIsNone(run_in_subinterpreter(self.script()))
+        data = ae.get_data(index_name=INDEX, channels=["CH:00"], start=START, end=END)
+        self.assertEqual(len(data["CH:00"]), 10)
+
+    @unittest.skipUnless(sys.version_info >= (3, 12), "subinterpreters have their own GIL since Python 3.12")
+    def test_own_gil(self):
+        error = run_in_subinterpreter("import archiveexport", isolated=True)
+        self.assertIn("ImportError", error)
+
+
+class ArchiveTest(unittest.TestCase):
+
+    @unittest.skipUnless(os.path.isdir("/proc/self/fd"), "needs /proc/self/fd")
+    def test_reader_limit(self):
+        with ae.Archive(INDEX) as archive:
+            fds = open_fds()
+            for channel in CHANNELS:
+                data = archive.get_data(channels=[channel], start=START, end=END)
+                self.assertEqual([row["value"] for row in data[channel]], list(range(10)))
+            # every channel has its own data file, only those of the last readers stay open
+            self.assertLessEqual(open_fds() - fds, 2 * MAX_READERS)
+
+            data = archive.get_data(pattern="CH:.*", start=START, end=END)
+            self.assertEqual(sorted(data), CHANNELS)
+            self.assertLessEqual(open_fds() - fds, 2 * MAX_READERS)
+
+            # a closed reader is opened again
+            data = archive.get_data(channels=[CHANNELS[0]], start=START, end=END)
+            self.assertEqual(len(data[CHANNELS[0]]), 10)
+        self.assertLessEqual(open_fds(), fds)
+
+
+if __name__ == "__main__":
+    # the first argument that is not an option of unittest
+    for arg in sys.argv[1:]:
+        if not arg.startswith("-"):
+            INDEX = arg
+            sys.argv.remove(arg)
+            break
+    unittest.main()
@@ -1,7 +1,10 @@
 /* #define AE_DEBUG */
 
 /* C, C++ */
+#include <math.h>
 #include <time.h> 
+#include <string.h>
+#include <mutex>
 #include <stdexcept>
 
 /* Python*/
@@ -184,6 +187,99 @@ void PyDict_SetItemDECREFItem(PyObject * dict, PyObject * key, PyObject * item)
 }
 
 
+static const char *result_key_names[RESULT_KEY_COUNT] = {
+    "value", "seconds", "nanoseconds", "status", "status_string",
+    "severity", "severity_string", "enum_string", "unit",
+    "low_alarm", "low_warn", "high_warn", "high_alarm",
+    "disp_low", "disp_high", "precision", "enum_strings",
+    "first", "count", "info", "samples", "bytes", "blocks", "valid",
+    "name", "size", "channels", "offset", "dtype", "shape", "time",
+    "last", "type", "reads", "sizes"
+};
+
+
+/*
+    Returns a new tuple of the strings, or NULL with PyExc set on failure.
+*/
+static PyObject *
+PyTuple_FromStrings(const char **strings, size_t count){
+    PyObject *tuple;
+    if(!(tuple = PyTuple_New(count))){
+        return NULL;
+    }
+    for(size_t i = 0; i < count; i++){
+        PyObject *string;
+        if(!(string = PyUnicode_Surrogateescape(strings[i]))){
+            Py_DECREF(tuple);
+            return NULL;
+        }
+        PyUnicode_InternInPlace(&string);
+        PyTuple_SetItem(tuple, i, string);
+    }
+    return tuple;
+}
+
+
+int ResultKeys_Init(ResultKeys &keys){
+    for(int i = 0; i < RESULT_KEY_COUNT; i++){
+        if(!(keys.key[i] = PyUnicode_InternFromString(result_key_names[i]))){
+            ResultKeys_Clear(keys);
+            return -1;
+        }
+    }
+    if(!(keys.status_strings = PyTuple_FromStrings(epicsAlarmConditionStrings,
+                                                   SIZEOF_ARRAY(epicsAlarmConditionStrings))) ||
+       !(keys.severity_strings = PyTuple_FromStrings(epicsAlarmSeverityStrings,
+                                                     SIZEOF_ARRAY(epicsAlarmSeverityStrings)))){
+        ResultKeys_Clear(keys);
+        return -1;
+    }
+    return 0;
+}
+
+
+void ResultKeys_Clear(ResultKeys &keys){
+    for(int i = 0; i < RESULT_KEY_COUNT; i++){
+        Py_CLEAR(keys.key[i]);
+    }
+    Py_CLEAR(keys.status_strings);
+    Py_CLEAR(keys.severity_strings);
+}
+
+
+PyObject *
+PyObject_GetAlarmString(PyObject *table, size_t code){
+    PyObject *string = Py_None;
+    if(code < (size_t) PyTuple_Size(table)){
+        string = PyTuple_GetItem(table, code);
+    }
+    Py_INCREF(string);
+    return string;
+}
+
+
+PyObject *
+PyList_FromEnumStates(const CtrlInfo &info){
+    PyObject *enum_strings;
+    if(!(enum_strings = PyList_New(0))){
+        throw std::runtime_error("List could not be created.");
+    }
+    try{
+        if(info.getType()==CtrlInfo::Enumerated){
+            for (size_t i = 0; i < info.getNumStates(); ++i){
+                stdString enum_string;
+                info.getState(i, enum_string);
+                PyList_AppendDECREF(enum_strings, PyUnicode_Surrogateescape(enum_string.c_str()));
+            }
+        }
+    }catch(std::exception &e){
+        Py_DECREF(enum_strings);
+        throw;
+    }
+    return enum_strings;
+}
+
+
 void PyDict_SetItemDECREF(PyObject * dict, PyObject * key, PyObject * item){
     try{
         PyDict_SetItemDECREFItem(dict, key, item);
@@ -219,8 +315,8 @@ PyObyect_getStatusString(const RawValue::Data *value){
 PyObject *
 PyObyect_getSeverityString(const RawValue::Data *value){
 
-    if(value && (size_t) value->status < SIZEOF_ARRAY(epicsAlarmSeverityStrings)) {
-        return PyUnicode_Surrogateescape(epicsAlarmSeverityStrings[value->status]);
+    if(value && (size_t) value->severity < SIZEOF_ARRAY(epicsAlarmSeverityStrings)) {
+        return PyUnicode_Surrogateescape(epicsAlarmSeverityStrings[value->severity]);
     }else{
         Py_RETURN_NONE;
     }
@@ -248,10 +344,30 @@ PyObject * PyUnicode_Surrogateescape(const char* string){
     return PyUnicode_DecodeLocale(string,"surrogateescape");
 }
 
-epicsTime EpicsTime_FromPyDateTime(PyDateTime_DateTime * py_datetime){
+/*
+    PyDateTimeAPI is a static of this file. The first interpreter that imports
+    the module sets it, later ones only check that their datetime module has
+    the same C API, which holds while _datetime keeps it in static storage.
+*/
+static std::mutex datetime_api_mutex;
 
-    /* import datetime API */
-    if(!PyDateTimeAPI) PyDateTime_IMPORT;
+int DateTime_Import(void){
+    PyDateTime_CAPI *api = (PyDateTime_CAPI *) PyCapsule_Import(PyDateTime_CAPSULE_NAME, 0);
+    if (!api){
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(datetime_api_mutex);
+    if (!PyDateTimeAPI){
+        PyDateTimeAPI = api;
+    }else if (PyDateTimeAPI != api){
+        PyErr_SetString(PyExc_ImportError, "archiveexport cannot use the datetime C API of this interpreter, "
+                        "it differs from the one of the interpreter that imported archiveexport first.");
+        return -1;
+    }
+    return 0;
+}
+
+epicsTime EpicsTime_FromPyDateTime(PyDateTime_DateTime * py_datetime){
 
     struct tm tm_time = {0};
     tm_time.tm_year = PyDateTime_GET_YEAR(py_datetime) - 1900;
@@ -260,6 +376,7 @@ epicsTime EpicsTime_FromPyDateTime(PyDateTime_DateTime * py_datetime){
     tm_time.tm_hour = PyDateTime_DATE_GET_HOUR(py_datetime);
     tm_time.tm_min = PyDateTime_DATE_GET_MINUTE(py_datetime);
     tm_time.tm_sec = PyDateTime_DATE_GET_SECOND(py_datetime);
+    tm_time.tm_isdst = -1; /* let mktime find out if daylight saving time applies */
 
     struct local_tm_nano_sec tm_nano_sec = {0};
     tm_nano_sec.ansi_tm = tm_time;
@@ -268,17 +385,733 @@ epicsTime EpicsTime_FromPyDateTime(PyDateTime_DateTime * py_datetime){
     return epicsTime(tm_nano_sec);
 }   
 
-int EpicsTime_FromPyDateTimeConverter(PyDateTime_DateTime * py_datetime, void * epics_time){
+/*
+    Days since 1970-01-01 of a date in the proleptic Gregorian calendar,
+    month 1...12.
+*/
+static long long
+DaysFromCivil(long long year, int month, int day){
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long year_of_era = year - era * 400;
+    long long day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    long long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
 
-    /* import datetime API */
-    if(!PyDateTimeAPI) PyDateTime_IMPORT;
+/*
+    Sets epics_time to seconds plus nanoseconds (0...999999999) since the Unix epoch.
+    Sets PyExc and returns 0 if the time cannot be held by an epics time stamp.
+*/
+static int
+EpicsTime_FromUnixTime(long long seconds, long long nanoseconds, epicsTime *epics_time){
 
-    if (!PyDateTime_Check(py_datetime)){
-        PyErr_SetString(PyExc_TypeError, "parameters specifying time should be of DateTime Type");
+    if (seconds < POSIX_TIME_AT_EPICS_EPOCH || seconds - POSIX_TIME_AT_EPICS_EPOCH > 0xFFFFFFFFLL){
+        PyErr_SetString(PyExc_ValueError, "Time is outside the range of Epics time stamps (1990 to 2126).");
         return 0;
     }
+    epicsTimeStamp stamp;
+    stamp.secPastEpoch = (epicsUInt32) (seconds - POSIX_TIME_AT_EPICS_EPOCH);
+    stamp.nsec = (epicsUInt32) nanoseconds;
+    *epics_time = epicsTime(stamp);
+    return 1;
+}
 
-    * (epicsTime* ) epics_time = EpicsTime_FromPyDateTime(py_datetime);
+/*
+    Converts an aware datetime with the given utcoffset() to epics time,
+    without going through the local timezone.
+*/
+static int
+EpicsTime_FromAwarePyDateTime(PyObject *py_datetime, PyObject *utc_offset, epicsTime *epics_time){
 
-    return 1;
+    if (!PyDelta_Check(utc_offset)){
+        PyErr_SetString(PyExc_TypeError, "utcoffset() should return a timedelta");
+        return 0;
+    }
+    long long days = DaysFromCivil(PyDateTime_GET_YEAR(py_datetime), PyDateTime_GET_MONTH(py_datetime),
+                                   PyDateTime_GET_DAY(py_datetime));
+    long long seconds = days * 86400
+                      + PyDateTime_DATE_GET_HOUR(py_datetime) * 3600
+                      + PyDateTime_DATE_GET_MINUTE(py_datetime) * 60
+                      + PyDateTime_DATE_GET_SECOND(py_datetime)
+                      - ((long long) PyDateTime_DELTA_GET_DAYS(utc_offset) * 86400
+                         + PyDateTime_DELTA_GET_SECONDS(utc_offset));
+    long long microseconds = PyDateTime_DATE_GET_MICROSECOND(py_datetime)
+                           - PyDateTime_DELTA_GET_MICROSECONDS(utc_offset);
+    if (microseconds < 0){
+        microseconds += 1000000;
+        --seconds;
+    }
+    return EpicsTime_FromUnixTime(seconds, microseconds * 1000, epics_time);
+}
+
+/*
+    Converts a numpy.datetime64 of any unit to epics time, numpy does the unit
+    conversion.
+*/
+static int
+EpicsTime_FromDatetime64(PyObject *datetime64, epicsTime *epics_time){
+
+    PyObject *ns, *ns_int;
+    if (!(ns = PyObject_CallMethod(datetime64, "astype", "s", "M8[ns]"))){
+        return 0;
+    }
+    ns_int = PyObject_CallMethod(ns, "astype", "s", "i8");
+    Py_DECREF(ns);
+    if (!ns_int){
+        return 0;
+    }
+    long long nanoseconds = PyLong_AsLongLong(ns_int);
+    Py_DECREF(ns_int);
+    if (nanoseconds == -1 && PyErr_Occurred()){
+        return 0;
+    }
+    // NaT is the smallest int64, which is out of range as well
+    long long seconds = nanoseconds / 1000000000;
+    nanoseconds %= 1000000000;
+    if (nanoseconds < 0){
+        nanoseconds += 1000000000;
+        --seconds;
+    }
+    return EpicsTime_FromUnixTime(seconds, nanoseconds, epics_time);
+}
+
+int EpicsTime_FromPyObjectConverter(PyObject * object, void * epics_time){
+
+    epicsTime *time = (epicsTime *) epics_time;
+    if (PyDateTime_Check(object)){
+        PyObject *utc_offset;
+        if (!(utc_offset = PyObject_CallMethod(object, "utcoffset", NULL))){
+            return 0;
+        }
+        int result = 1;
+        if (utc_offset == Py_None){
+            *time = EpicsTime_FromPyDateTime((PyDateTime_DateTime *) object);
+        }else{
+            result = EpicsTime_FromAwarePyDateTime(object, utc_offset, time);
+        }
+        Py_DECREF(utc_offset);
+        return result;
+    }
+    if (strcmp(Py_TYPE(object)->tp_name, "numpy.datetime64") == 0){
+        // checked by name, so numpy is only needed if it is used
+        return EpicsTime_FromDatetime64(object, time);
+    }
+    if (PyFloat_Check(object)){
+        double value = PyFloat_AS_DOUBLE(object);
+        double seconds = floor(value);
+        if (!(seconds >= POSIX_TIME_AT_EPICS_EPOCH && seconds <= POSIX_TIME_AT_EPICS_EPOCH + 4294967295.0)){
+            return EpicsTime_FromUnixTime(-1, 0, time); // out of range, also NaN
+        }
+        long long nanoseconds = llround((value - seconds) * 1e9);
+        if (nanoseconds >= 1000000000){
+            nanoseconds -= 1000000000;
+            seconds += 1;
+        }
+        return EpicsTime_FromUnixTime((long long) seconds, nanoseconds, time);
+    }
+    if (PyIndex_Check(object)){
+        PyObject *index;
+        if (!(index = PyNumber_Index(object))){
+            return 0;
+        }
+        int overflow;
+        long long seconds = PyLong_AsLongLongAndOverflow(index, &overflow);
+        Py_DECREF(index);
+        if (seconds == -1 && PyErr_Occurred()){
+            return 0;
+        }
+        return EpicsTime_FromUnixTime(overflow ? -1 : seconds, 0, time);
+    }
+    PyErr_SetString(PyExc_TypeError, "parameters specifying time should be datetime, numpy.datetime64 "
+                                     "or seconds since the Unix epoch");
+    return 0;
+}
+
+PyObject *PyDateTime_FromEpicsTime(const epicsTime &time){
+
+    local_tm_nano_sec tm_nano_sec = time;
+    const struct tm &tm_time = tm_nano_sec.ansi_tm;
+
+    return PyDateTime_FromDateAndTime(tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+                                      tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec,
+                                      tm_nano_sec.nSec / 1000);
+}
+
+
+const char *
+NumpyDtype_FromDBRType(DbrType type){
+    switch (type)
+    {
+        case DBR_TIME_STRING: return "S40";
+        case DBR_TIME_CHAR:   return "u1";
+        case DBR_TIME_ENUM:   return "u2";
+        case DBR_TIME_SHORT:  return "i2";
+        case DBR_TIME_LONG:   return "i4";
+        case DBR_TIME_FLOAT:  return "f4";
+        case DBR_TIME_DOUBLE: return "f8";
+    }
+    return NULL;
+}
+
+PyObject *
+Numpy_GetEmpty(void){
+    PyObject *numpy;
+    if(!(numpy = PyImport_ImportModule("numpy"))){
+        return NULL; // PyExc is set by PyImport_ImportModule
+    }
+    PyObject *numpy_empty = PyObject_GetAttrString(numpy, "empty");
+    Py_DECREF(numpy);
+    return numpy_empty;
+}
+
+PyObject *
+PyArray_EmptyWithBuffer(PyObject *numpy_empty, Py_ssize_t n, const char *dtype, Py_buffer *view,
+                        Py_ssize_t count){
+    PyObject *array;
+    if(count > 1){
+        array = PyObject_CallFunction(numpy_empty, "(nn)s", n, count, dtype);
+    }else{
+        array = PyObject_CallFunction(numpy_empty, "ns", n, dtype);
+    }
+    if(!array){
+        return NULL;
+    }
+    if(PyObject_GetBuffer(array, view, PyBUF_WRITABLE|PyBUF_C_CONTIGUOUS) == -1){
+        Py_DECREF(array);
+        return NULL;
+    }
+    return array;
+}
+
+/*
+    Creates a numpy array of dtype with one element per sample of the segment
+    and sets element i to field(segment.get(i)).
+*/
+template <typename T, typename F>
+static PyObject *
+PyArray_GatherField(PyObject *numpy_empty, const SampleSegment &segment, const char *dtype, F field){
+    Py_buffer view;
+    PyObject *array;
+    Py_ssize_t n = segment.size();
+    if(!(array = PyArray_EmptyWithBuffer(numpy_empty, n, dtype, &view))){
+        return NULL;
+    }
+    T *dst = (T *) view.buf;
+    for (Py_ssize_t i = 0; i < n; ++i){
+        dst[i] = field(segment.get(i));
+    }
+    PyBuffer_Release(&view);
+    return array;
+}
+
+/*
+    Creates a numpy array of dtype, of shape (n, count) for array channels, and copies
+    the value part of all samples of the segment into it.
+*/
+static PyObject *
+PyArray_GatherValues(PyObject *numpy_empty, const SampleSegment &segment, const char *dtype){
+    Py_buffer view;
+    PyObject *array;
+    Py_ssize_t n = segment.size();
+    if(!(array = PyArray_EmptyWithBuffer(numpy_empty, n, dtype, &view, segment.count))){
+        return NULL;
+    }
+    size_t value_size = dbr_value_size[segment.type] * segment.count;
+    char *dst = (char *) view.buf;
+    for (Py_ssize_t i = 0; i < n; ++i){
+        memcpy(dst + i * value_size, dbr_value_ptr(segment.get(i), segment.type), value_size);
+    }
+    PyBuffer_Release(&view);
+    return array;
+}
+
+/*
+    Creates the "time" array of the segment, int64 nanoseconds since the Unix epoch,
+    viewed as datetime64[ns] for TIMESTAMPS_DATETIME64.
+*/
+static PyObject *
+PyArray_GatherTimes(PyObject *numpy_empty, const SampleSegment &segment, TimestampFormat timestamps){
+    PyObject *array;
+    if(!(array = PyArray_GatherField<int64_t>(numpy_empty, segment, "i8", getUnixNanoseconds))){
+        return NULL;
+    }
+    if(timestamps != TIMESTAMPS_DATETIME64){
+        return array;
+    }
+    // numpy does not export datetime64 buffers, so the array is filled as int64 first
+    PyObject *datetime64 = PyObject_CallMethod(array, "view", "s", "M8[ns]");
+    Py_DECREF(array);
+    return datetime64;
+}
+
+PyObject *
+PyDict_FromSampleSegment(const SampleSegment &segment, PyObject *numpy_empty, TimestampFormat timestamps,
+                         const ResultKeys &keys){
+
+    const char *dtype = NumpyDtype_FromDBRType(segment.type);
+    if(!dtype){
+        PyErr_SetString(PyExc_TypeError, "Unexpected DBR Type");
+        return NULL;
+    }
+
+    PyObject *dict;
+    if(!(dict = PyDict_New())){
+        return NULL;
+    }
+
+    try{
+        PyDict_SetItemDECREFItem(dict, keys[KEY_VALUE], PyArray_GatherValues(numpy_empty, segment, dtype));
+        if(timestamps == TIMESTAMPS_EPICS){
+            PyDict_SetItemDECREFItem(dict, keys[KEY_SECONDS], PyArray_GatherField<int64_t>(numpy_empty, segment, "i8",
+                [](const RawValue::Data *value){ return value->stamp.secPastEpoch; }));
+            PyDict_SetItemDECREFItem(dict, keys[KEY_NANOSECONDS], PyArray_GatherField<int64_t>(numpy_empty, segment, "i8",
+                [](const RawValue::Data *value){ return value->stamp.nsec; }));
+        }else{
+            PyDict_SetItemDECREFItem(dict, keys[KEY_TIME], PyArray_GatherTimes(numpy_empty, segment, timestamps));
+        }
+        PyDict_SetItemDECREFItem(dict, keys[KEY_STATUS], PyArray_GatherField<uint16_t>(numpy_empty, segment, "u2",
+            [](const RawValue::Data *value){ return value->status; }));
+        PyDict_SetItemDECREFItem(dict, keys[KEY_SEVERITY], PyArray_GatherField<uint16_t>(numpy_empty, segment, "u2",
+            [](const RawValue::Data *value){ return value->severity; }));
+    }
+    catch(std::exception &e){
+        Py_DECREF(dict);
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        return NULL;
+    }
+    return dict;
+}
+
+/*
+    Returns a new reference to the state string of an enum value from the list
+    of PyList_FromEnumStates, or Py_None if there is no such state.
+*/
+static PyObject *
+PyObject_GetEnumString(PyObject *enum_strings, const RawValue::Data *value){
+    size_t enum_idx = ((dbr_time_enum *)value)->value;
+    PyObject *enum_string = Py_None;
+    if(enum_strings && enum_idx < (size_t) PyList_Size(enum_strings)){
+        enum_string = PyList_GetItem(enum_strings, enum_idx);
+    }
+    Py_INCREF(enum_string);
+    return enum_string;
+}
+
+/*
+    Sets "value", "seconds", "nanoseconds" (or "time") and with get_status the status and
+    severity keys of a row dict. Throws std::runtime_error on failure.
+*/
+static void
+PyDict_SetSampleItems(PyObject *row_dict, const SampleSegment &segment, const RawValue::Data *value, bool get_status,
+                      TimestampFormat timestamps, const ResultKeys &keys){
+
+    // value 
+    PyDict_SetItemDECREFItem(row_dict, keys[KEY_VALUE], PyObject_FromDBRType(value, segment.type, segment.count));
+    if(timestamps == TIMESTAMPS_EPICS){
+        // sec 
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_SECONDS], PyLong_FromLong(value->stamp.secPastEpoch)); 
+        // nsec 
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_NANOSECONDS], PyLong_FromLong(value->stamp.nsec));
+    }else{
+        // ns since the Unix epoch
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_TIME], PyLong_FromLongLong(getUnixNanoseconds(value)));
+    }
+    // status & severity
+    if(get_status){
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_STATUS], PyLong_FromLong(value->status));
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_STATUS_STRING],
+                                 PyObject_GetAlarmString(keys.status_strings, value->status));
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_SEVERITY], PyLong_FromLong(value->severity));
+        PyDict_SetItemDECREFItem(row_dict, keys[KEY_SEVERITY_STRING],
+                                 PyObject_GetAlarmString(keys.severity_strings, value->severity));
+    }
+}
+
+/*
+    Creates the dict of one info segment, see PyList_FromCtrlInfoSegments.
+    Throws std::runtime_error on failure.
+*/
+static PyObject *
+PyDict_FromCtrlInfo(const CtrlInfo &info, size_t first, size_t count, bool get_units, bool get_info,
+                    const ResultKeys &keys){
+
+    PyObject *info_dict;
+    if(!(info_dict = PyDict_New())){
+        throw std::runtime_error("info_dict could not be created.");
+    }
+    try{
+        PyDict_SetItemDECREFItem(info_dict, keys[KEY_FIRST], PyLong_FromSize_t(first));
+        PyDict_SetItemDECREFItem(info_dict, keys[KEY_COUNT], PyLong_FromSize_t(count));
+        // units  - surrogateescape does not fail on undecodable characters
+        if(get_units && info.getType()==CtrlInfo::Numeric){
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_UNIT], PyUnicode_Surrogateescape(info.getUnits()));
+        }
+        if(get_info && info.getType()==CtrlInfo::Numeric){
+            // all limit values are achived as floats
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_LOW_ALARM], PyFloat_FromDouble(info.getLowAlarm()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_LOW_WARN], PyFloat_FromDouble(info.getLowWarning()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_HIGH_WARN], PyFloat_FromDouble(info.getHighWarning()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_HIGH_ALARM], PyFloat_FromDouble(info.getHighAlarm()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_DISP_LOW], PyFloat_FromDouble(info.getDisplayLow()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_DISP_HIGH], PyFloat_FromDouble(info.getDisplayHigh()));
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_PRECISION], PyLong_FromLong(info.getPrecision()));
+        }
+        if(get_info && info.getType()==CtrlInfo::Enumerated){
+            PyDict_SetItemDECREFItem(info_dict, keys[KEY_ENUM_STRINGS], PyList_FromEnumStates(info));
+        }
+    }catch(std::exception &e){
+        Py_DECREF(info_dict);
+        throw;
+    }
+    return info_dict;
+}
+
+PyObject *
+PyList_FromCtrlInfoSegments(const ChannelSamples &samples, size_t begin, size_t end, bool get_units, bool get_info,
+                            const ResultKeys &keys){
+
+    PyObject *info_list;
+    if(!(info_list = PyList_New(0))) {
+        PyErr_SetString(PyExc_RuntimeError, "List could not be created.");
+        return NULL;
+    }
+
+    try{
+        for (size_t i = 0; i < samples.infos.size(); ++i){
+            size_t first = samples.infos[i].first;
+            size_t last  = i + 1 < samples.infos.size() ? samples.infos[i + 1].first : samples.size();
+            // clip to [begin, end)
+            if (first < begin)
+                first = begin;
+            if (last > end)
+                last = end;
+            if (first >= last)
+                continue;
+            PyList_AppendDECREF(info_list, PyDict_FromCtrlInfo(samples.infos[i].info, first - begin, last - first,
+                                                               get_units, get_info, keys));
+        }
+    }
+    catch(std::exception &e){
+        Py_DECREF(info_list);
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        return NULL;
+    }
+    return info_list;
+}
+
+/*
+    Converts one segment like PyDict_FromSampleSegment and adds the "info" list for
+    samples [begin, begin + segment.size()) of the channel if get_units or get_info is set.
+*/
+static PyObject *
+PyDict_FromSampleSegmentWithInfo(const ChannelSamples &samples, const SampleSegment &segment, size_t begin,
+                                 PyObject *numpy_empty, bool get_units, bool get_info, TimestampFormat timestamps,
+                                 const ResultKeys &keys){
+
+    PyObject *dict;
+    if(!(dict = PyDict_FromSampleSegment(segment, numpy_empty, timestamps, keys))){
+        return NULL;
+    }
+    if(get_units || get_info){
+        PyObject *info_list;
+        if(!(info_list = PyList_FromCtrlInfoSegments(samples, begin, begin + segment.size(), get_units, get_info, keys)) ||
+           PyDict_SetItem(dict, keys[KEY_INFO], info_list) == -1){
+            Py_XDECREF(info_list);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(info_list);
+    }
+    return dict;
+}
+
+PyObject *
+PyObject_FromChannelSamples(const ChannelSamples &samples, PyObject *numpy_empty, bool get_units, bool get_info,
+                            TimestampFormat timestamps, const ResultKeys &keys){
+
+    if(samples.segments.empty()){
+        // no samples, type is unknown
+        return PyDict_FromSampleSegmentWithInfo(samples, SampleSegment(DBR_TIME_DOUBLE, 1), 0,
+                                                numpy_empty, get_units, get_info, timestamps, keys);
+    }
+    if(samples.segments.size() == 1){
+        return PyDict_FromSampleSegmentWithInfo(samples, samples.segments[0], 0,
+                                                numpy_empty, get_units, get_info, timestamps, keys);
+    }
+
+    PyObject *list;
+    if(!(list = PyList_New(samples.segments.size()))){
+        return NULL;
+    }
+    size_t begin = 0; // index of the first sample of segment i
+    for (size_t i = 0; i < samples.segments.size(); ++i){
+        PyObject *dict;
+        if(!(dict = PyDict_FromSampleSegmentWithInfo(samples, samples.segments[i], begin,
+                                                     numpy_empty, get_units, get_info, timestamps, keys))){
+            Py_DECREF(list);
+            return NULL;
+        }
+        if(PyList_SetItem(list, i, dict) == -1){
+            Py_DECREF(list);
+            return NULL;
+        }
+        begin += samples.segments[i].size();
+    }
+    return list;
+}
+
+/*
+    Creates the dict {"offset": offset, "dtype": dtype, "shape": (n,) or (n, count)}
+    of a shared memory column. Throws std::runtime_error on failure.
+*/
+static PyObject *
+PyDict_FromShmColumn(size_t offset, const char *dtype, size_t n, size_t count, const ResultKeys &keys){
+
+    PyObject *column;
+    if(!(column = PyDict_New())){
+        throw std::runtime_error("Dict could not be created.");
+    }
+    try{
+        PyDict_SetItemDECREFItem(column, keys[KEY_OFFSET], PyLong_FromSize_t(offset));
+        PyDict_SetItemDECREFItem(column, keys[KEY_DTYPE], PyUnicode_FromString(dtype));
+        PyDict_SetItemDECREFItem(column, keys[KEY_SHAPE], count > 1 ? Py_BuildValue("(nn)", (Py_ssize_t) n, (Py_ssize_t) count)
+                                                                     : Py_BuildValue("(n)", (Py_ssize_t) n));
+    }catch(std::exception &e){
+        Py_DECREF(column);
+        throw;
+    }
+    return column;
+}
+
+/*
+    Describes one segment of a shared memory result and adds the "info" list for
+    samples [begin, begin + segment.size) of the channel if get_units or get_info is set.
+*/
+static PyObject *
+PyDict_FromShmSegment(const ChannelSamples &samples, const ShmSegment &segment, size_t begin,
+                      bool get_units, bool get_info, TimestampFormat timestamps, const ResultKeys &keys){
+
+    const char *dtype = NumpyDtype_FromDBRType(segment.type);
+    if(!dtype){
+        PyErr_SetString(PyExc_TypeError, "Unexpected DBR Type");
+        return NULL;
+    }
+
+    PyObject *dict;
+    if(!(dict = PyDict_New())){
+        return NULL;
+    }
+    try{
+        size_t n = segment.size;
+        PyDict_SetItemDECREFItem(dict, keys[KEY_VALUE], PyDict_FromShmColumn(segment.value, dtype, n, segment.count, keys));
+        if(timestamps == TIMESTAMPS_EPICS){
+            PyDict_SetItemDECREFItem(dict, keys[KEY_SECONDS], PyDict_FromShmColumn(segment.seconds, "i8", n, 1, keys));
+            PyDict_SetItemDECREFItem(dict, keys[KEY_NANOSECONDS], PyDict_FromShmColumn(segment.nanoseconds, "i8", n, 1, keys));
+        }else{
+            PyDict_SetItemDECREFItem(dict, keys[KEY_TIME], PyDict_FromShmColumn(segment.time,
+                timestamps == TIMESTAMPS_DATETIME64 ? "M8[ns]" : "i8", n, 1, keys));
+        }
+        PyDict_SetItemDECREFItem(dict, keys[KEY_STATUS], PyDict_FromShmColumn(segment.status, "u2", n, 1, keys));
+        PyDict_SetItemDECREFItem(dict, keys[KEY_SEVERITY], PyDict_FromShmColumn(segment.severity, "u2", n, 1, keys));
+        if(get_units || get_info){
+            PyDict_SetItemDECREFItem(dict, keys[KEY_INFO],
+                                     PyList_FromCtrlInfoSegments(samples, begin, begin + n, get_units, get_info, keys));
+        }
+    }catch(std::exception &e){
+        Py_DECREF(dict);
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        return NULL;
+    }
+    return dict;
+}
+
+PyObject *
+PyObject_FromShmSegments(const ChannelSamples &samples, const std::vector<ShmSegment> &segments,
+                         bool get_units, bool get_info, TimestampFormat timestamps, const ResultKeys &keys){
+
+    if(segments.size() == 1){
+        return PyDict_FromShmSegment(samples, segments[0], 0, get_units, get_info, timestamps, keys);
+    }
+
+    PyObject *list;
+    if(!(list = PyList_New(segments.size()))){
+        return NULL;
+    }
+    size_t begin = 0; // index of the first sample of segment i
+    for (size_t i = 0; i < segments.size(); ++i){
+        PyObject *dict;
+        if(!(dict = PyDict_FromShmSegment(samples, segments[i], begin, get_units, get_info, timestamps, keys))){
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SetItem(list, i, dict);
+        begin += segments[i].size;
+    }
+    return list;
+}
+
+PyObject *
+PyList_FromChannelSamples(const ChannelSamples &samples, bool get_units, bool get_status, bool get_info,
+                          TimestampFormat timestamps, const ResultKeys &keys){
+
+    PyObject *value_list;
+    if(!(value_list = PyList_New(0))) {
+        PyErr_SetString(PyExc_RuntimeError, "List could not be created.");
+        return NULL;
+    }
+
+    size_t n = 0;     // index of the sample over all segments
+    size_t info = 0;  // index of the CtrlInfoSegment that covers sample n
+    // unit and enum strings of info, created once per CtrlInfoSegment and shared by its rows
+    PyObject *unit = NULL;
+    PyObject *enum_strings = NULL;
+    size_t strings_info = samples.infos.size();
+    try{
+        for (size_t s = 0; s < samples.segments.size(); ++s){
+            const SampleSegment &segment = samples.segments[s];
+            for (size_t i = 0; i < segment.size(); ++i, ++n){
+                while (info + 1 < samples.infos.size() && samples.infos[info + 1].first <= n){
+                    ++info;
+                }
+                const RawValue::Data *value = segment.get(i);
+                const CtrlInfo &ctrl_info = samples.infos[info].info;
+                if(strings_info != info && (get_units || get_info)){
+                    Py_CLEAR(unit);
+                    Py_CLEAR(enum_strings);
+                    strings_info = info;
+                    if(get_units && ctrl_info.getType()==CtrlInfo::Numeric &&
+                       !(unit = PyUnicode_Surrogateescape(ctrl_info.getUnits()))){
+                        throw std::runtime_error("Unit could not be decoded.");
+                    }
+                    if(get_info){
+                        enum_strings = PyList_FromEnumStates(ctrl_info);
+                    }
+                }
+
+                // create a placeholder for the value
+                PyObject *row_dict;
+
+                if(!(row_dict = PyDict_New())){
+                    throw std::runtime_error("row_dict could not be created.");
+                }
+
+                try{
+                    PyDict_SetSampleItems(row_dict, segment, value, get_status, timestamps, keys);
+                    // units  - surrogateescape does not fail on undecodable characters
+                    if(unit){
+                        Py_INCREF(unit);
+                        PyDict_SetItemDECREFItem(row_dict, keys[KEY_UNIT], unit);
+                    }
+                    // info
+                    if(get_info){
+                        if(ctrl_info.getType()==CtrlInfo::Numeric){
+                            // all limit values are achived as floats
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_LOW_ALARM], PyFloat_FromDouble(ctrl_info.getLowAlarm()));
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_LOW_WARN], PyFloat_FromDouble(ctrl_info.getLowWarning()));
+                            // the rows keep their historical swap of high_warn and high_alarm,
+                            // PyDict_FromCtrlInfo names them after the getters
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_HIGH_WARN], PyFloat_FromDouble(ctrl_info.getHighAlarm()));
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_HIGH_ALARM], PyFloat_FromDouble(ctrl_info.getHighWarning()));
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_DISP_LOW], PyFloat_FromDouble(ctrl_info.getDisplayLow()));
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_DISP_HIGH], PyFloat_FromDouble(ctrl_info.getDisplayHigh()));
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_PRECISION], PyLong_FromLong(ctrl_info.getPrecision()));
+                        }
+                        if(segment.type==DBR_TIME_ENUM) {
+                            PyDict_SetItemDECREFItem(row_dict, keys[KEY_ENUM_STRING],
+                                                     PyObject_GetEnumString(enum_strings, value));
+                        }
+                    }
+                }
+                catch(std::exception &e){
+                    Py_DECREF(row_dict);
+                    throw;
+                }
+                // append dict to the list 
+                PyList_AppendDECREF(value_list, row_dict);
+            }
+        }
+    }
+    catch(std::exception &e){
+        Py_XDECREF(unit);
+        Py_XDECREF(enum_strings);
+        Py_DECREF(value_list);
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        return NULL;
+    }
+    Py_XDECREF(unit);
+    Py_XDECREF(enum_strings);
+    return value_list;
+}
+
+PyObject *
+PyDict_FromChannelSamples(const ChannelSamples &samples, bool get_units, bool get_status, bool get_info,
+                          TimestampFormat timestamps, const ResultKeys &keys){
+
+    PyObject *channel_dict;
+    if(!(channel_dict = PyDict_New())) {
+        PyErr_SetString(PyExc_RuntimeError, "Dict could not be created.");
+        return NULL;
+    }
+
+    PyObject *info_list;
+    if(!(info_list = PyList_FromCtrlInfoSegments(samples, 0, samples.size(), get_units, get_info, keys))){
+        Py_DECREF(channel_dict);
+        return NULL;
+    }
+
+    size_t n = 0;     // index of the sample over all segments
+    size_t info = 0;  // index of the CtrlInfoSegment that covers sample n
+    try{
+        PyDict_SetItemDECREFItem(channel_dict, keys[KEY_INFO], info_list);
+
+        PyObject *value_list;
+        if(!(value_list = PyList_New(samples.size()))) {
+            throw std::runtime_error("List could not be created.");
+        }
+        PyDict_SetItemDECREFItem(channel_dict, keys[KEY_SAMPLES], value_list);
+
+        for (size_t s = 0; s < samples.segments.size(); ++s){
+            const SampleSegment &segment = samples.segments[s];
+            for (size_t i = 0; i < segment.size(); ++i, ++n){
+                while (info + 1 < samples.infos.size() && samples.infos[info + 1].first <= n){
+                    ++info;
+                }
+                const RawValue::Data *value = segment.get(i);
+
+                PyObject *row_dict;
+                if(!(row_dict = PyDict_New())){
+                    throw std::runtime_error("row_dict could not be created.");
+                }
+                if(PyList_SetItem(value_list, n, row_dict) == -1){
+                    throw std::runtime_error("Item could not be set.");
+                }
+
+                PyDict_SetSampleItems(row_dict, segment, value, get_status, timestamps, keys);
+                PyDict_SetItemDECREFItem(row_dict, keys[KEY_INFO], PyLong_FromSize_t(info));
+                // enum strings are shared with the info segment,
+                // info_list has one entry per CtrlInfoSegment since none of them is empty
+                if(get_info && segment.type==DBR_TIME_ENUM){
+                    PyObject *enum_strings = PyDict_GetItem(PyList_GetItem(info_list, info), keys[KEY_ENUM_STRINGS]);
+                    PyDict_SetItemDECREFItem(row_dict, keys[KEY_ENUM_STRING], PyObject_GetEnumString(enum_strings, value));
+                }
+            }
+        }
+    }
+    catch(std::exception &e){
+        Py_DECREF(channel_dict);
+        if(!PyErr_Occurred()){
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        }
+        return NULL;
+    }
+    return channel_dict;
 }
@@ -8,9 +8,12 @@
 #include "RawValue.h"
 #include "CtrlInfo.h"
 
+#include "query.h"
+#include "shm.h"
+
 // Epics alarmStrings.h has problems with being included multiple times
-extern const char* epicsAlarmConditionStrings[4];
-extern const char* epicsAlarmSeverityStrings[22];
+extern const char* epicsAlarmConditionStrings[22];
+extern const char* epicsAlarmSeverityStrings[4];
 
 /*
     This function returns a suitable PyObject depending on the epics DBR Type.
@@ -48,6 +51,25 @@ PyObyect_getSeverityString(const RawValue::Data *value);
 PyObject *
 PyObyect_getEnumString(const RawValue::Data *value, const CtrlInfo info);
 
+/*
+    How the time stamps of samples are returned, see archiveexport_get_data:
+        TIMESTAMPS_EPICS      ... "seconds" and "nanoseconds" since the Epics epoch (1990)
+        TIMESTAMPS_NS         ... "time", int64 nanoseconds since the Unix epoch
+        TIMESTAMPS_DATETIME64 ... "time" as numpy datetime64[ns], only for numpy arrays
+*/
+enum TimestampFormat {
+    TIMESTAMPS_EPICS, TIMESTAMPS_NS, TIMESTAMPS_DATETIME64
+};
+
+/*
+    Imports the datetime C API for the converters below, once from the module
+    exec instead of on first use, which would race in free-threaded builds.
+    All interpreters share the API of the first one, an interpreter whose
+    datetime module has another API gets an ImportError.
+    Returns -1 with PyExc set on failure.
+*/
+int DateTime_Import(void);
+
 /*
     Takes PyDateTime as an argument and returns epicsTime.
 */
@@ -55,9 +77,22 @@ epicsTime EpicsTime_FromPyDateTime(PyDateTime_DateTime * py_datetime);
 
 /*
     This is a converter function used by PyArg_ParseTupleAndKeywords. It creates
-    new epics time object and assigns it to time.
+    new epics time object and assigns it to time. Takes
+        datetime         ... naive ones in local time, see EpicsTime_FromPyDateTime,
+                             aware ones are converted with their UTC offset instead
+        numpy.datetime64 ... of any unit
+        int, float       ... seconds since the Unix epoch, like time.time()
+    Only the naive datetime depends on the local timezone.
+    Sets PyExc and returns 0 on failure, also for times before the Epics epoch
+    given as anything but a naive datetime.
 */
-int EpicsTime_FromPyDateTimeConverter(PyDateTime_DateTime * py_datetime, void * epics_time);
+int EpicsTime_FromPyObjectConverter(PyObject * object, void * epics_time);
+
+/*
+    Takes epicsTime and returns a naive PyDateTime in local time, the inverse of
+    EpicsTime_FromPyDateTime (to the microsecond).
+*/
+PyObject *PyDateTime_FromEpicsTime(const epicsTime &time);
 
 /* 
     PyDict_SetItemString increases reference count for the item, so it needs to be decreased,
@@ -85,6 +120,59 @@ void PyDict_SetItemDECREF(PyObject* dict, PyObject* key, PyObject* item);
 */
 void PyDict_SetItemDECREFItem(PyObject* dict, PyObject* key, PyObject* item);
 
+/*
+    Keys of the result dicts. They are interned once per module by ResultKeys_Init,
+    so building a row does not hash and look up a fresh key string for every item.
+*/
+enum ResultKey {
+    KEY_VALUE, KEY_SECONDS, KEY_NANOSECONDS, KEY_STATUS, KEY_STATUS_STRING,
+    KEY_SEVERITY, KEY_SEVERITY_STRING, KEY_ENUM_STRING, KEY_UNIT,
+    KEY_LOW_ALARM, KEY_LOW_WARN, KEY_HIGH_WARN, KEY_HIGH_ALARM,
+    KEY_DISP_LOW, KEY_DISP_HIGH, KEY_PRECISION, KEY_ENUM_STRINGS,
+    KEY_FIRST, KEY_COUNT, KEY_INFO, KEY_SAMPLES, KEY_BYTES, KEY_BLOCKS, KEY_VALID,
+    KEY_NAME, KEY_SIZE, KEY_CHANNELS, KEY_OFFSET, KEY_DTYPE, KEY_SHAPE, KEY_TIME,
+    KEY_LAST, KEY_TYPE, KEY_READS, KEY_SIZES,
+    RESULT_KEY_COUNT
+};
+
+/*
+    The interned keys, held in the module state so every (sub)interpreter
+    has its own strings. Plain data, zeroed memory is a valid empty table.
+    status_strings and severity_strings are tuples of the alarm strings indexed
+    by the status and severity codes, so the rows share one string per code.
+*/
+struct ResultKeys
+{
+    PyObject *key[RESULT_KEY_COUNT];
+    PyObject *status_strings;
+    PyObject *severity_strings;
+
+    PyObject *operator [] (ResultKey k) const { return key[k]; }
+};
+
+/*
+    Interns all result keys into keys and creates the alarm string tables.
+    Returns -1 with PyExc set on failure.
+*/
+int ResultKeys_Init(ResultKeys &keys);
+
+/* Releases the keys */
+void ResultKeys_Clear(ResultKeys &keys);
+
+/*
+    Returns a new reference to table[code] of one of the alarm string tables
+    in ResultKeys, or Py_None if code is out of its range.
+*/
+PyObject *
+PyObject_GetAlarmString(PyObject *table, size_t code);
+
+/*
+    Returns a PyList of the state strings of an enum CtrlInfo, an empty list for other types.
+    Throws std::runtime_error on failure.
+*/
+PyObject *
+PyList_FromEnumStates(const CtrlInfo &info);
+
 /* 
     PyList_Append  increases reference counts for the item. It needs to be decreased,
     if it is used only within the list and no where else separately.
@@ -100,4 +188,114 @@ void PyList_AppendDECREF(PyObject * list, PyObject * item);
 PyObject *
 PyUnicode_Surrogateescape(const char* string);
 
+/*
+    Returns the numpy dtype string matching the epics DBR Type:
+        DBR_TIME_STRING ... "S40" (MAX_STRING_SIZE bytes)
+        DBR_TIME_CHAR   ... "u1"
+        DBR_TIME_ENUM   ... "u2"
+        DBR_TIME_SHORT  ... "i2"
+        DBR_TIME_LONG   ... "i4"
+        DBR_TIME_FLOAT  ... "f4"
+        DBR_TIME_DOUBLE ... "f8"
+    If type does not match one of the DBR types listed above the function returns NULL.
+*/
+const char *
+NumpyDtype_FromDBRType(DbrType type);
+
+/*
+    Imports numpy and returns a new reference to numpy.empty, or NULL with
+    PyExc set if numpy is not available.
+*/
+PyObject *
+Numpy_GetEmpty(void);
+
+/*
+    Creates a new 1-D numpy array of length n by calling numpy_empty(n, dtype), or a
+    2-D array of shape (n, count) if count > 1, and gets its writable, contiguous
+    buffer into view. The caller fills view->buf and releases the view with
+    PyBuffer_Release. Returns NULL with PyExc set on failure.
+*/
+PyObject *
+PyArray_EmptyWithBuffer(PyObject *numpy_empty, Py_ssize_t n, const char *dtype, Py_buffer *view,
+                        Py_ssize_t count = 1);
+
+/*
+    Converts a segment to a dict of numpy arrays without creating per-sample objects:
+        "value"       ... DBR value type, see NumpyDtype_FromDBRType, with
+                          shape (n, count) for array channels (count > 1)
+        "seconds"     ... int64, seconds past since Epics epoch
+        "nanoseconds" ... int64
+        "status"      ... uint16
+        "severity"    ... uint16
+    With TIMESTAMPS_NS or TIMESTAMPS_DATETIME64 there is one "time" array, int64 or
+    datetime64[ns], instead of "seconds" and "nanoseconds".
+*/
+PyObject *
+PyDict_FromSampleSegment(const SampleSegment &segment, PyObject *numpy_empty, TimestampFormat timestamps,
+                         const ResultKeys &keys);
+
+/*
+    Converts the CtrlInfoSegments of samples [begin, end) of a channel to a PyList
+    with one dict per segment:
+        "first"         ... index of the first sample of the segment, relative to begin
+        "count"         ... number of samples in the segment
+        "unit"          ... with get_units, for numeric channels
+        "low_alarm", "low_warn", "high_warn", "high_alarm", "disp_low", "disp_high", "precision"
+                        ... with get_info, for numeric channels
+        "enum_strings"  ... with get_info, list of the state strings for enum channels
+*/
+PyObject *
+PyList_FromCtrlInfoSegments(const ChannelSamples &samples, size_t begin, size_t end, bool get_units, bool get_info,
+                            const ResultKeys &keys);
+
+/*
+    Converts all samples of a channel to numpy arrays. Returns a dict as described in
+    PyDict_FromSampleSegment, or a list of such dicts if the DBR type changed within
+    the time range. A channel without samples gives a dict of empty arrays.
+    With get_units or get_info every dict also gets an "info" list for its samples,
+    see PyList_FromCtrlInfoSegments.
+*/
+PyObject *
+PyObject_FromChannelSamples(const ChannelSamples &samples, PyObject *numpy_empty, bool get_units, bool get_info,
+                            TimestampFormat timestamps, const ResultKeys &keys);
+
+/*
+    Describes the segments of a channel in a shared memory result, see writeSharedMemory.
+    Returns a dict with one entry per column, or a list of such dicts if the DBR type
+    changed within the time range:
+        {"value": {"offset": offset, "dtype": dtype, "shape": (n,)}, "seconds": {...}, ...}
+    "shape" of "value" is (n, count) for array channels. With get_units or get_info
+    every dict also gets an "info" list, see PyList_FromCtrlInfoSegments.
+    timestamps selects the time columns as in PyDict_FromSampleSegment, it must match
+    the unix_time the samples were written with.
+*/
+PyObject *
+PyObject_FromShmSegments(const ChannelSamples &samples, const std::vector<ShmSegment> &segments,
+                         bool get_units, bool get_info, TimestampFormat timestamps, const ResultKeys &keys);
+
+/*
+    Converts all samples of a channel to a PyList with one dict per sample:
+        {"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, ...}
+    get_units, get_status and get_info add the keys described in archiveexport_get_data.
+    With TIMESTAMPS_NS the rows hold "time" instead of "seconds" and "nanoseconds".
+*/
+PyObject *
+PyList_FromChannelSamples(const ChannelSamples &samples, bool get_units, bool get_status, bool get_info,
+                          TimestampFormat timestamps, const ResultKeys &keys);
+
+/*
+    Converts all samples of a channel to a dict that holds the CtrlInfo only once
+    per change instead of in every row:
+        {
+            "samples": [{"value":value ,"seconds":seconds, "nanoseconds":nanoseconds, "info":0, ...}, ...],
+            "info":    [{"first":0, "count":count, "unit":unit, ...}, ...]
+        }
+    "info" of a row is the index of its info segment, see PyList_FromCtrlInfoSegments.
+    get_status adds the status keys to the rows, get_info the "enum_string" of enums,
+    timestamps as for PyList_FromChannelSamples.
+*/
+PyObject *
+PyDict_FromChannelSamples(const ChannelSamples &samples, bool get_units, bool get_status, bool get_info,
+                          TimestampFormat timestamps, const ResultKeys &keys);
+
 #endif
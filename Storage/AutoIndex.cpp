@@ -91,3 +91,9 @@ bool AutoIndex::getNextChannel(NameIterator &iter)
     return index->getNextChannel(iter);
 }
 
+class RTree *AutoIndex::getTree(const NameIterator &iter,
+                                stdString &directory)
+{
+    return index->getTree(iter, directory);
+}
+
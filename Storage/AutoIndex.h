@@ -37,6 +37,9 @@ public:
 
     virtual bool getNextChannel(NameIterator &iter);
 
+    virtual class RTree *getTree(const NameIterator &iter,
+                                 stdString &directory);
+
 private:
     PROHIBIT_DEFAULT_COPY(AutoIndex);
     stdString filename;
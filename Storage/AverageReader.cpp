@@ -7,6 +7,7 @@
 
 AverageReader::AverageReader(Index &index, double delta)
   : reader(index),
+    batches(reader),
     delta(delta),
     reader_data(0),
     type(0),
@@ -21,6 +22,7 @@ const RawValue::Data *AverageReader::find(
 {
     this->channel_name = channel_name;
     reader_data = reader.find(channel_name, start);
+    batches.reset();
     if (!reader_data)
         return 0;
     // The reported time stamp will be end_of_bin-delta/2.
@@ -29,7 +31,7 @@ const RawValue::Data *AverageReader::find(
         end_of_bin = *start + delta/2.0;
         while (RawValue::getTime(reader_data) < *start)
         {
-            reader_data = reader.next();
+            reader_data = batches.next();
             if (!reader_data)
                 return 0;
         }
@@ -67,7 +69,7 @@ const RawValue::Data *AverageReader::next()
         RawValue::show(stdout, reader.getType(), reader.getCount(),
                        reader_data, &reader.getInfo());
 #       endif
-        // copy reader_data before calling reader.next()
+        // copy reader_data before calling batches.next()
         if (reader.changedInfo())
         {
             info = reader.getInfo();
@@ -91,7 +93,7 @@ const RawValue::Data *AverageReader::next()
                 sevr = RawValue::getSevr(data);
                 stat = RawValue::getStat(data);
             }
-            reader_data = reader.next();
+            reader_data = batches.next();
         }
         else
         {   // Special values, non-scalars and non-numerics
@@ -100,7 +102,7 @@ const RawValue::Data *AverageReader::next()
             N = 0;
             do
             {
-                reader_data = reader.next();
+                reader_data = batches.next();
 #ifdef DEBUG_AVGREAD
                 printf("Moving forward to: ");
                 RawValue::show(stdout, reader.getType(), reader.getCount(),
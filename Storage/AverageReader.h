@@ -49,6 +49,7 @@ public:
 
 protected:
     RawDataReader reader;
+    DataBatchIterator batches; // steps through reader for the bins
     double delta;
 
     // Current value of reader
@@ -267,9 +267,7 @@ void CtrlInfo::read(DataFile *datafile, FileOffset offset)
 {
     // read size field only
     uint16_t size;
-    if (fseek(datafile->file, offset, SEEK_SET) != 0 ||
-        (FileOffset) ftell(datafile->file) != offset ||
-        fread(&size, sizeof size, 1, datafile->file) != 1)
+    if (!datafile->readAt(offset, &size, sizeof size))
     {
         _infobuf.mem()->type = Invalid;
         throw GenericException(__FILE__, __LINE__,
@@ -306,8 +304,8 @@ void CtrlInfo::read(DataFile *datafile, FileOffset offset)
                                (unsigned long)offset);
     }
     // read remainder of CtrlInfo:
-    if (fread(((char *)info) + sizeof size,
-              info->size - sizeof size, 1, datafile->file) != 1)
+    if (!datafile->readAt(offset + sizeof size, ((char *)info) + sizeof size,
+                          info->size - sizeof size))
     {
         info->type = Invalid;
         throw GenericException(__FILE__, __LINE__,
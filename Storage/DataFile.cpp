@@ -26,7 +26,20 @@
 // List of all DataFiles currently open
 // We assume that there aren't that many open,
 // so a simple list is sufficient.
-static stdList<DataFile *> open_data_files;
+//
+// Each thread has its own list, so readers running in
+// different threads never share a DataFile and with it
+// the position of the underlying FILE.
+// Files that are fully released get closed when the thread exits.
+class DataFileList : public stdList<DataFile *>
+{
+public:
+    ~DataFileList()
+    {
+        DataFile::clear_cache();
+    }
+};
+static thread_local DataFileList open_data_files;
 
 DataFile::DataFile(const stdString &dirname,
                    const stdString &basename,
@@ -153,6 +166,7 @@ FileOffset DataFile::getSize() const
 void DataFile::reopen()
 {
     is_new_file = is_tagged_file = false;
+    reader = 0;
     // Try existing
     if (for_write)
         file.open(filename.c_str(), "r+b");
@@ -160,13 +174,14 @@ void DataFile::reopen()
         file.open(filename.c_str(), "rb");
     if (file)
     {   // Opened existing file. Check type
-        uint32_t file_cookie;
-        if (fseek(file, 0, SEEK_SET) != 0  ||
-            readLong(file, &file_cookie) == false)
+        reader = FileReader::create(file, for_write);
+        uint8_t buffer[4];
+        const uint8_t *c = buffer;
+        if (!readAt(0, buffer, 4))
             throw GenericException(__FILE__, __LINE__,
                                    "DataFile(%s): Read error",
                                    filename.c_str());
-        is_tagged_file = file_cookie == cookie;
+        is_tagged_file = getLong(c) == cookie;
 #ifdef LOG_DATAFILE
         LOG_MSG("DataFile %s opened for %s\n",
                 filename.c_str(), (for_write?"writing":"read-only access"));
@@ -184,6 +199,7 @@ void DataFile::reopen()
                                "DataFile(%s): Cannot create new file.",
                                filename.c_str());
     is_new_file = true;
+    reader = FileReader::create(file, for_write);
     if (fseek(file, 0, SEEK_SET) != 0  ||
         writeLong(file, cookie) == false)
         throw GenericException(__FILE__, __LINE__,
@@ -195,6 +211,11 @@ void DataFile::reopen()
 #endif
 }
 
+bool DataFile::readAt(FileOffset offset, void *buffer, size_t size)
+{
+    return reader  &&  reader->read(offset, buffer, size);
+}
+
 size_t DataFile::clear_cache()
 {
     size_t left = 0;
@@ -370,9 +391,7 @@ size_t DataHeader::capacity()
 void DataHeader::read(FileOffset offset)
 {
     this->offset = offset;
-    if (fseek(datafile->file, offset, SEEK_SET) != 0   ||
-        (FileOffset)ftell(datafile->file) != offset  ||
-        fread(&data, sizeof(struct DataHeaderData), 1, datafile->file) != 1)
+    if (!datafile->readAt(offset, &data, sizeof(struct DataHeaderData)))
     {
         clear();
         throw GenericException(__FILE__, __LINE__,
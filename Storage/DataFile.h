@@ -8,6 +8,7 @@
 #include <Filename.h>
 #include <AutoPtr.h>
 #include <AutoFilePtr.h>
+#include <FileReader.h>
 // Storage
 #include <RawValue.h>
 
@@ -26,6 +27,14 @@
 /// - During a write cycle, it is likely that at least some of the channels
 ///   reference the same files, and voila: The file is already open.
 /// - Finally, clear_cache() should be called to close all the data files.
+///
+/// The cache is kept per thread: reference(), clear_cache() and close_all()
+/// only see the data files of the calling thread, so readers in different
+/// threads each get their own file handles.
+///
+/// Data files are read via a FileReader, so files opened read-only
+/// are by default memory mapped and reading data that's already
+/// in the page cache takes no system calls.
 class DataFile
 {
 public:
@@ -167,6 +176,10 @@ private:
     // Close file.
     ~DataFile();
 
+    // Read 'size' bytes at 'offset' into buffer.
+    // Returns false on error.
+    bool readAt(FileOffset offset, void *buffer, size_t size);
+
     // prohibit assignment or implicit copy:
     // (these are not implemented, use reference() !)
     DataFile(const DataFile &other);
@@ -174,6 +187,8 @@ private:
 
     // The current data file
     AutoFilePtr file;
+    // ... and its reader, see FileReader::create()
+    AutoPtr<FileReader> reader;
     size_t ref_count;
     bool   for_write;
     bool   is_tagged_file;
@@ -1,5 +1,7 @@
 
 
+// Base
+#include <epicsThread.h>
 // Tools
 #include <UnitTest.h>
 // Storage
@@ -53,3 +55,120 @@ TEST_CASE test_data_file()
 
     TEST_OK;
 }
+
+// References the demo data file from another thread.
+class DataFileThread : public epicsThreadRunable
+{
+public:
+    DataFileThread()
+        : datafile(0), left(1),
+          thread(*this, "DataFileThread",
+                 epicsThreadGetStackSize(epicsThreadStackSmall),
+                 epicsThreadPriorityMedium)
+    {
+        thread.start();
+        thread.exitWait();
+    }
+
+    void run()
+    {
+        try
+        {
+            datafile = DataFile::reference("../DemoData", "20040305", false);
+            datafile->release();
+            left = DataFile::clear_cache();
+        }
+        catch (GenericException &e)
+        {
+            printf("Exception:\n%s\n", e.what());
+        }
+    }
+
+    DataFile *datafile;
+    size_t left;
+private:
+    epicsThread thread;
+};
+
+TEST_CASE test_data_file_per_thread()
+{
+    try
+    {
+        DataFile *df1 = DataFile::reference("../DemoData", "20040305", false);
+        TEST_MSG(df1, "Opened file");
+
+        // Another thread gets its own DataFile for the same file,
+        // and clearing its cache does not close ours.
+        DataFileThread other;
+        TEST(other.datafile != 0);
+        TEST(other.datafile != df1);
+        TEST(other.left == 0);
+        TEST(df1->refCount() == 1);
+        TEST(DataFile::clear_cache() == 1);
+
+        df1->release();
+        DataFile::close_all();
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        FAIL("Caught exception");
+    }
+
+    TEST_OK;
+}
+
+// Reads headers of a data file that's still growing,
+// with each FileReader method.
+TEST_CASE test_data_file_mapping()
+{
+    FileReader::Method initial = FileReader::getDefaultMethod();
+    TEST_DELETE_FILE("test/data_file.data");
+    try
+    {
+        DataFile *writer = DataFile::reference("test", "data_file.data", true);
+        TEST(writer->is_new_file);
+        DataHeader *header = writer->addHeader("fred", DBR_TIME_DOUBLE, 1,
+                                               1.0, 10);
+        FileOffset first = header->offset;
+        delete header;
+        for (int m=0; m<FileReader::num_methods; ++m)
+        {
+            FileReader::setDefaultMethod((FileReader::Method) m);
+            printf("Method '%s'\n", FileReader::getName((FileReader::Method) m));
+            DataFile *reader = DataFile::reference("test", "data_file.data", false);
+            TEST(reader != writer);
+            reader->reopen();
+            header = reader->getHeader(first);
+            TEST(header->data.dbr_type == DBR_TIME_DOUBLE);
+            TEST(header->capacity() == 10);
+            delete header;
+
+            // Reader finds what's added after it opened the file
+            header = writer->addHeader("jane", DBR_TIME_LONG, 1, 2.0, 20);
+            FileOffset second = header->offset;
+            delete header;
+            TEST(second > first);
+            header = reader->getHeader(second);
+            TEST(header->data.dbr_type == DBR_TIME_LONG);
+            TEST(header->capacity() == 20);
+            TEST(header->data.period == 2.0);
+            delete header;
+            reader->release();
+        }
+        writer->release();
+        DataFile::close_all();
+    }
+    catch (GenericException &e)
+    {
+        FileReader::setDefaultMethod(initial);
+        printf("Exception:\n%s\n", e.what());
+        FAIL("Caught exception");
+    }
+    FileReader::setDefaultMethod(initial);
+    FileReader::Stats stats;
+    FileReader::getStats(FileReader::Pread, stats);
+    TEST(stats.reads > 0);
+    TEST(stats.bytes >= stats.reads);
+    TEST_OK;
+}
@@ -6,6 +6,15 @@
 DataReader::~DataReader()
 {}
 
+void DataReader::setBounds(const epicsTime *end, size_t max_samples)
+{}
+
+size_t DataReader::nextBatch(size_t max_values, const RawValue::Data *&values)
+{
+    values = next();
+    return values ? 1 : 0;
+}
+
 void DataReader::toString(stdString &text) const
 {
     const RawValue::Data *value = get();
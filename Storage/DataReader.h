@@ -64,12 +64,54 @@ public:
     ///            called after reaching the end of data.
     virtual const RawValue::Data *next() = 0;
 
+    /// Obtain the next values at once.
+    ///
+    /// Same as up to max_values calls to next(), but the values
+    /// are returned as one contiguous array, each value
+    /// RawValue::getSize(getType(), getCount()) bytes after the previous.
+    /// A batch never spans a change of type, count or ctrl_info,
+    /// so getType(), getCount() and getInfo() hold for all its values,
+    /// and changedType() and changedInfo() report changes
+    /// up to its first value.
+    /// Like next(), a batch can include special 'info' records.
+    ///
+    /// The default implementation returns one value of next() at a time.
+    ///
+    /// @pre find()
+    ///
+    /// @param max_values: maximum number of values, at least 1
+    /// @param values: set to the first value of the batch.
+    ///        Valid until the next call to find(), next() or nextBatch().
+    ///        The caller must neither modify nor delete the data!
+    /// @return Returns number of values, 0 at the end of data.
+    ///
+    /// @exception GenericException on error, see next().
+    virtual size_t nextBatch(size_t max_values, const RawValue::Data *&values);
+
+    /// Limit the values returned after the next find().
+    ///
+    /// Once find() or next() returned a value (not a special 'info'
+    /// record) with a time stamp at-or-after end,
+    /// or max_samples such values, next() returns 0 without
+    /// reading any further data blocks.
+    ///
+    /// The bounds stay in effect for following calls to find()
+    /// until they are changed again.
+    /// The default implementation ignores them,
+    /// so callers must still check end and max_samples themselves;
+    /// the bounds only let a reader stop its I/O early.
+    ///
+    /// @param end: end time or 0 for no end
+    /// @param max_samples: maximum number of values or 0 for no limit
+    virtual void setBounds(const epicsTime *end, size_t max_samples);
+
     /// Name of the channel, i.e. the one passed to find()
     stdString channel_name;
     
     /// Current value.
     ///
-    /// Same as the last find() or next() result.
+    /// Same as the last find() or next() result,
+    /// or the last value of the last nextBatch() result.
     /// Undefined when find() or next() returned 0.
     virtual const RawValue::Data *get() const = 0;
 
@@ -106,6 +148,49 @@ private:
     PROHIBIT_DEFAULT_COPY(DataReader);
 };
 
+/// Steps through the values of a DataReader batch by batch.
+///
+/// next() works like DataReader::next(), but only calls
+/// DataReader::nextBatch() whenever a batch is used up,
+/// so a tight loop over the values avoids a virtual call per value.
+/// While a batch lasts, the reader's get() is the last value of the batch,
+/// getType(), getInfo() etc. are those of the current value.
+class DataBatchIterator
+{
+public:
+    DataBatchIterator(DataReader &reader)
+        : reader(reader), values(0), num(0), idx(0), size(0)
+    {}
+
+    /// Drop the rest of the current batch, needed after reader.find().
+    void reset()
+    {   num = idx = 0; }
+
+    /// Next value of the reader, see DataReader::next().
+    const RawValue::Data *next()
+    {
+        if (idx + 1 < num)
+        {
+            ++idx;
+            return (const RawValue::Data *) ((const char *) values + idx*size);
+        }
+        idx = 0;
+        num = reader.nextBatch((size_t) -1, values);
+        if (num == 0)
+            return 0;
+        size = RawValue::getSize(reader.getType(), reader.getCount());
+        return values;
+    }
+
+private:
+    PROHIBIT_DEFAULT_COPY(DataBatchIterator);
+    DataReader &reader;
+    const RawValue::Data *values; // current batch
+    size_t num;  // values in batch
+    size_t idx;  // current value in batch
+    size_t size; // bytes per value
+};
+
 /// @}
 
 #endif
@@ -56,6 +56,7 @@ bool FileAllocator::attach(FILE *f, IndexFileOffset reserved_space, bool init)
 #endif
     LOG_ASSERT(f != 0);
     this->f = f;
+    reader = FileReader::create(f, init);
     this->reserved_space = reserved_space;
     if (fseeko(this->f, 0, SEEK_END))
         throw GenericException(__FILE__, __LINE__, "fseeko error");
@@ -102,8 +103,15 @@ FILE *FileAllocator::getFile() const
     return f;
 }
 
+FileReader &FileAllocator::getReader() const
+{
+    LOG_ASSERT(reader);
+    return *reader;
+}
+
 void FileAllocator::detach()
 {
+    reader = 0;
     f = 0;
 #ifdef DEBUG_FA
     printf("FileAllocator::detach()\n");
@@ -380,13 +388,15 @@ bool FileAllocator::dump(int level, FILE *f)
 
 void FileAllocator::read_node(IndexFileOffset offset, list_node *node)
 {
-    if (! (fseeko(f, offset, SEEK_SET) == 0  &&
-           ReadIndexFileOffset(f, &node->bytes, file_offset_size) &&
-           ReadIndexFileOffset(f, &node->prev,  file_offset_size) &&
-           ReadIndexFileOffset(f, &node->next,  file_offset_size)))
+    uint8_t buffer[3*8];
+    const uint8_t *c = buffer;
+    if (!reader->read(offset, buffer, 3*IndexFileOffsetBytes(file_offset_size)))
         throw GenericException(__FILE__, __LINE__,
                                "FileAllocator node read at 0x%08lX failed",
                                (unsigned long)offset);
+    node->bytes = GetIndexFileOffset(c, file_offset_size);
+    node->prev  = GetIndexFileOffset(c, file_offset_size);
+    node->next  = GetIndexFileOffset(c, file_offset_size);
 }
 
 void FileAllocator::write_node(IndexFileOffset offset, const list_node *node)
@@ -5,6 +5,9 @@
 
 // System
 #include <stdio.h>
+// Tools
+#include <AutoPtr.h>
+#include <FileReader.h>
 // Storage
 #include <StorageTypes.h>
 
@@ -57,6 +60,13 @@ public:
 
     /// After attaching to a file, this returns the file
     FILE *getFile() const;
+
+    /// After attaching to a file, this returns the reader for it.
+    ///
+    /// Reads of the file should use this reader,
+    /// writes go to getFile().
+    /// @see FileReader::create()
+    FileReader &getReader() const;
     
     /// <B>Must be</B> called before destroying the FileAllocator and closing the file.
     void detach();
@@ -121,6 +131,7 @@ private:
     } list_node;
     
     FILE *f;
+    AutoPtr<FileReader> reader;
     IndexFileOffset reserved_space; // Bytes we ignore in header
     IndexFileOffset file_size; // Total # of bytes in file
     // For the head nodes,
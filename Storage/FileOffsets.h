@@ -37,6 +37,21 @@ inline bool readUint64(FILE *f, uint64_t *value)
     return true;
 }
 
+inline uint64_t getUint64(const uint8_t *&c)
+{
+    uint64_t value =
+        ((uint64_t)c[0]) << 56 |
+        ((uint64_t)c[1]) << 48 |
+        ((uint64_t)c[2]) << 40 |
+        ((uint64_t)c[3]) << 32 |
+        ((uint64_t)c[4]) << 24 |
+        ((uint64_t)c[5]) << 16 |
+        ((uint64_t)c[6]) <<  8 |
+         (uint64_t)c[7];
+    c += 8;
+    return value;
+}
+
 #define IndexFileOffset uint64_t
 
 inline bool ReadIndexFileOffset(FILE *f, uint64_t *value, int size)
@@ -54,6 +69,25 @@ inline bool ReadIndexFileOffset(FILE *f, uint64_t *value, int size)
     }
 }
 
+// Bytes on disk for an offset of 'size' bits
+inline size_t IndexFileOffsetBytes(int size)
+{
+    return size == 32 ? 4 : 8;
+}
+
+// Get offset of 'size' bits from memory, advancing c
+inline uint64_t GetIndexFileOffset(const uint8_t *&c, int size)
+{
+    if(size == 32)
+    {
+        return getLong(c);
+    }
+    else
+    {
+        return getUint64(c);
+    }
+}
+
 inline bool WriteIndexFileOffset(FILE *f, uint64_t value, int size)
 {
     if(size == 32)
@@ -55,7 +55,7 @@ public:
     class NameIterator
     {
     public:
-        const stdString &getName() 
+        const stdString &getName() const
         {    return entry.name; }
     private:
         friend class IndexFile;
@@ -77,6 +77,19 @@ public:
     /// @pre Successfull call to get_first_channel().
     /// @return true if there was another entry.
     virtual bool getNextChannel(NameIterator &iter) = 0;
+
+    /// Obtain the RTree for the channel a NameIterator is on.
+    ///
+    /// Same as getTree() for the name of the iterator,
+    /// but an index that keeps the location of the RTree
+    /// in its name entries can skip looking up the name again.
+    ///
+    /// @return RTree pointer which caller must delete.
+    ///         Returns 0 if the channel is not found.
+    /// @exception GenericException on internal error.
+    virtual class RTree *getTree(const NameIterator &iter,
+                                 stdString &directory)
+    {   return getTree(iter.getName(), directory); }
 protected:
     PROHIBIT_DEFAULT_COPY(Index);
 };
@@ -70,8 +70,14 @@ void IndexFile::open(const stdString &filename, bool readonly)
                                (new_file ? "create" : "open"),
                                filename.c_str());
     // TODO: Tune these two. All 0 seems best?!
-    FileAllocator::minimum_size = 0;
-    FileAllocator::file_size_increment = 0;
+    // They are process-wide and only used when allocating,
+    // so leave them alone for read-only files that may be
+    // opened by several threads at once.
+    if (!readonly)
+    {
+        FileAllocator::minimum_size = 0;
+        FileAllocator::file_size_increment = 0;
+    }
     fa.attach(f, 4+NameHash::anchor_size, !readonly);
     if (new_file)
     {
@@ -88,14 +94,13 @@ void IndexFile::open(const stdString &filename, bool readonly)
     }
     // Check existing file
     uint32_t file_cookie;
-    if (fseek(f, 0, SEEK_SET))
-        throw GenericException(__FILE__, __LINE__,
-                               "IndexFile::open(%s) seek error",     
-                               filename.c_str());
-    if (!readLong(f, &file_cookie))
+    uint8_t buffer[4];
+    const uint8_t *c = buffer;
+    if (!fa.getReader().read(0, buffer, 4))
         throw GenericException(__FILE__, __LINE__,
                                "IndexFile::open(%s) cannot read cookie.",
                                filename.c_str());
+    file_cookie = getLong(c);
 
     if(file_cookie == cookie_32)
     {
@@ -170,6 +175,17 @@ RTree *IndexFile::getTree(const stdString &channel, stdString &directory)
     IndexFileOffset tree_anchor;
     if (!names.find(channel, tree_filename, tree_anchor))
         return 0; // All OK, but channel not found.
+    return getTree(channel, tree_anchor, directory);
+}
+
+RTree *IndexFile::getTree(const NameIterator &iter, stdString &directory)
+{
+    return getTree(iter.entry.name, iter.entry.ID, directory);
+}
+
+RTree *IndexFile::getTree(const stdString &channel, IndexFileOffset tree_anchor,
+                          stdString &directory)
+{
     // Using AutoPtr in case e.g. tree->reattach throws exception.
     AutoPtr<RTree> tree;
     try
@@ -51,6 +51,10 @@ public:
 
     bool getNextChannel(NameIterator &iter);
 
+    /// Uses the RTree anchor of the iterator's name entry,
+    /// no hash lookup.
+    class RTree *getTree(const NameIterator &iter, stdString &directory);
+
     void showStats(FILE *f);   
 
     bool check(int level);
@@ -61,6 +65,9 @@ private:
     FileAllocator fa;
     NameHash names;
     stdString dirname;
+
+    class RTree *getTree(const stdString &channel, IndexFileOffset tree_anchor,
+                         stdString &directory);
 };
 
 /// @}
@@ -15,6 +15,7 @@ const RawValue::Data *LinearReader::find(
 {
     this->channel_name = channel_name;
     reader_data = reader.find(channel_name, start);
+    batches.reset();
     if (!reader_data)
         return 0;
     if (start)
@@ -52,7 +53,7 @@ const RawValue::Data *LinearReader::next()
         RawValue::show(stdout, reader.getType(), reader.getCount(),
                        reader_data, &reader.getInfo());
 #endif
-        // copy reader_data before calling reader.next()
+        // copy reader_data before calling batches.next()
         if (reader.changedInfo())
         {
             info = reader.getInfo();
@@ -67,7 +68,7 @@ const RawValue::Data *LinearReader::next()
         }
         RawValue::copy(type, count, data, reader_data);
         // Advance reader.
-        reader_data = reader.next();
+        reader_data = batches.next();
         if (count==1  &&  !RawValue::isInfo(data) &&
             RawValue::getDouble(type, count, data, d0))
         {
@@ -33,18 +33,20 @@ void NameHash::Entry::write(FILE *f, int file_offset_size) const
                                (unsigned long) offset);
 }
 
-void NameHash::Entry::read(FILE *f, int file_offset_size)
+void NameHash::Entry::read(FileReader &reader, int file_offset_size)
 {
     char buffer[100];
     unsigned short name_len, ID_len;
-    if (!(fseeko(f, offset, SEEK_SET)==0 &&
-          ReadIndexFileOffset(f, &next, file_offset_size) &&
-          ReadIndexFileOffset(f, &ID, file_offset_size) &&
-          readShort(f, &name_len) &&
-          readShort(f, &ID_len)))
+    size_t head = 2*IndexFileOffsetBytes(file_offset_size) + 2 + 2;
+    const uint8_t *c = (const uint8_t *) buffer;
+    if (!reader.read(offset, buffer, head))
         throw GenericException(__FILE__, __LINE__,
                                "read error at 0x%08lX",
                                (unsigned long) offset);
+    next = GetIndexFileOffset(c, file_offset_size);
+    ID = GetIndexFileOffset(c, file_offset_size);
+    name_len = getShort(c);
+    ID_len = getShort(c);
     if (name_len >= sizeof(buffer)-1)
         throw GenericException(__FILE__, __LINE__,
                                "Entry's name (%d) exceeds buffer size\n",
@@ -53,7 +55,7 @@ void NameHash::Entry::read(FILE *f, int file_offset_size)
         throw GenericException(__FILE__, __LINE__,
                                "Entry's ID_txt (%d) exceeds buffer size\n",
                                (int)ID_len);
-    if (fread(buffer, name_len, 1, f) != 1)
+    if (!reader.read(offset + head, buffer, name_len))
         throw GenericException(__FILE__, __LINE__,
                                "Read error for name of entry @ 0x%lX\n",
                                (unsigned long)offset);
@@ -64,7 +66,7 @@ void NameHash::Entry::read(FILE *f, int file_offset_size)
                                name.c_str(), (unsigned long)offset);
     if (ID_len > 0)
     {
-        if (fread(buffer, ID_len, 1, f) != 1)
+        if (!reader.read(offset + head + name_len, buffer, ID_len))
             throw GenericException(__FILE__, __LINE__,
                                    "Read error for ID_txt of entry @ 0x%lX\n",
                                    (unsigned long)offset);
@@ -79,7 +81,8 @@ void NameHash::Entry::read(FILE *f, int file_offset_size)
 }
 
 NameHash::NameHash(FileAllocator &fa, IndexFileOffset anchor)
-        : fa(fa), anchor(anchor), ht_size(0), table_offset(0)
+        : fa(fa), anchor(anchor), ht_size(0), table_offset(0),
+          ht_chunk_start(0), ht_chunk_count(0)
 {}
 
 void NameHash::init(uint32_t ht_size)
@@ -105,11 +108,15 @@ void NameHash::init(uint32_t ht_size)
 
 void NameHash::reattach()
 {
-    if (fseeko(fa.getFile(), anchor, SEEK_SET) != 0 ||
-        !ReadIndexFileOffset(fa.getFile(), &table_offset, fa.file_offset_size) ||
-        !readLong(fa.getFile(), &ht_size))
+    uint8_t buffer[8+4];
+    const uint8_t *c = buffer;
+    if (!fa.getReader().read(anchor, buffer,
+                             IndexFileOffsetBytes(fa.file_offset_size) + 4))
         throw GenericException(__FILE__, __LINE__,
                                "NameHash::readLong: Cannot read anchor info\n");
+    table_offset = GetIndexFileOffset(c, fa.file_offset_size);
+    ht_size = getLong(c);
+    ht_chunk_count = 0;
 }
     
 bool NameHash::insert(const stdString &name,
@@ -133,7 +140,7 @@ bool NameHash::insert(const stdString &name,
     }    
     while (true)
     {
-        entry.read(f, fa.file_offset_size);
+        entry.read(fa.getReader(), fa.file_offset_size);
         if (entry.name == name)
         {   // Update existing entry
             entry.ID_txt = ID_txt;
@@ -164,11 +171,10 @@ bool NameHash::find(const stdString &name, stdString &ID_txt, IndexFileOffset &I
     LOG_ASSERT(name.length() > 0);
     uint32_t h = hash(name);
     Entry entry;
-    FILE *f = fa.getFile();
     read_HT_entry(h, entry.offset);
     while (entry.offset)
     {
-        entry.read(f, fa.file_offset_size);
+        entry.read(fa.getReader(), fa.file_offset_size);
         if (entry.name == name)
         {   // Found!
             ID_txt = entry.ID_txt;
@@ -183,23 +189,12 @@ bool NameHash::find(const stdString &name, stdString &ID_txt, IndexFileOffset &I
 
 bool NameHash::startIteration(uint32_t &hashvalue, Entry &entry)
 {
-    FILE *f = fa.getFile();
-    if (fseeko(f, table_offset, SEEK_SET))
-        throw GenericException(__FILE__, __LINE__,
-                               "Seek 0x%08lX failed\n",
-                               (unsigned long)table_offset);
-    for (hashvalue=0; hashvalue<ht_size; ++hashvalue)
-    {   // Find first uses entry in hash table
-        if (!ReadIndexFileOffset(f, &entry.offset, fa.file_offset_size))
-            throw GenericException(__FILE__, __LINE__,
-                                   "Cannot read hash table @ 0x%08lX\n",
-                                   (unsigned long)table_offset);
-        if (entry.offset)
-            break;
-    }
-    if (! entry.offset)
+    // Read the table again, it might have changed since the last iteration
+    ht_chunk_count = 0;
+    hashvalue = 0;
+    if (!next_used_HT_entry(hashvalue, entry.offset))
         return false; // nothing found
-    entry.read(f, fa.file_offset_size);
+    entry.read(fa.getReader(), fa.file_offset_size);
     return true; // found the initial entry
 }
 
@@ -209,16 +204,11 @@ bool NameHash::nextIteration(uint32_t &hashvalue, Entry &entry)
         entry.offset = entry.next;
     else
     {   // Find next used entry in hash table
-        for (++hashvalue; hashvalue<ht_size; ++hashvalue)
-        {
-            read_HT_entry(hashvalue, entry.offset);
-            if (entry.offset)
-                break;
-        }
+        ++hashvalue;
+        if (!next_used_HT_entry(hashvalue, entry.offset))
+            return false; // no more entries for you!
     }
-    if (hashvalue >= ht_size  ||  entry.offset == 0)
-        return false; // no more entries for you!
-    entry.read(fa.getFile(), fa.file_offset_size);
+    entry.read(fa.getReader(), fa.file_offset_size);
     return true; // found another entry
 }
 
@@ -235,26 +225,23 @@ uint32_t NameHash::hash(const stdString &name) const
 void NameHash::showStats(FILE *f)
 {
     unsigned long l, used_entries = 0, total_list_length = 0, max_length = 0;
-    unsigned long hashvalue;
+    uint32_t hashvalue;
     Entry entry;
-    for (hashvalue=0; hashvalue<ht_size; ++hashvalue)
+    ht_chunk_count = 0;
+    for (hashvalue=0; next_used_HT_entry(hashvalue, entry.offset); ++hashvalue)
     {
-        read_HT_entry(hashvalue, entry.offset);
-        if (entry.offset)
+        ++used_entries;
+        l = 0;
+        do
         {
-            ++used_entries;
-            l = 0;
-            do
-            {
-                entry.read(fa.getFile(), fa.file_offset_size);
-                ++l;
-                ++total_list_length;
-                entry.offset = entry.next;
-            }
-            while (entry.offset);
-            if (l > max_length)
-                max_length = l;
+            entry.read(fa.getReader(), fa.file_offset_size);
+            ++l;
+            ++total_list_length;
+            entry.offset = entry.next;
         }
+        while (entry.offset);
+        if (l > max_length)
+            max_length = l;
     }
     fprintf(f, "Hash table fill ratio: %ld out of %ld entries (%ld %%)\n",
             used_entries, (unsigned long)ht_size, used_entries*100/ht_size);
@@ -268,17 +255,53 @@ void NameHash::read_HT_entry(uint32_t hash_value, IndexFileOffset &offset)
 {
     LOG_ASSERT(hash_value >= 0 && hash_value < ht_size);
     IndexFileOffset o = table_offset + hash_value * (fa.file_offset_size / 8);
-    if (!(fseeko(fa.getFile(), o, SEEK_SET)==0 &&
-          ReadIndexFileOffset(fa.getFile(), &offset, fa.file_offset_size)))
+    uint8_t buffer[8];
+    const uint8_t *c = buffer;
+    if (!fa.getReader().read(o, buffer, IndexFileOffsetBytes(fa.file_offset_size)))
         throw GenericException(__FILE__, __LINE__,
                                "Cannot read HT entry @ 0x%lX\n",
                                (long)hash_value);
+    offset = GetIndexFileOffset(c, fa.file_offset_size);
 } 
 
+bool NameHash::next_used_HT_entry(uint32_t &hash_value, IndexFileOffset &offset)
+{
+    int bytes = IndexFileOffsetBytes(fa.file_offset_size);
+    for (; hash_value < ht_size; ++hash_value)
+    {
+        if (hash_value < ht_chunk_start  ||
+            hash_value >= ht_chunk_start + ht_chunk_count)
+        {   // Read the chunk starting at hash_value
+            uint32_t count = ht_size - hash_value;
+            if (count > ht_chunk_size)
+                count = ht_chunk_size;
+            uint8_t buffer[ht_chunk_size * 8];
+            const uint8_t *c = buffer;
+            uint32_t i;
+            ht_chunk_count = 0;
+            if (!fa.getReader().read(table_offset + hash_value * bytes,
+                                     buffer, count * bytes))
+                throw GenericException(__FILE__, __LINE__,
+                                       "Cannot read hash table @ 0x%08lX\n",
+                                       (unsigned long)table_offset);
+            for (i=0; i<count; ++i)
+                ht_chunk[i] = GetIndexFileOffset(c, fa.file_offset_size);
+            ht_chunk_start = hash_value;
+            ht_chunk_count = count;
+        }
+        offset = ht_chunk[hash_value - ht_chunk_start];
+        if (offset)
+            return true;
+    }
+    offset = 0;
+    return false;
+}
+
 void NameHash::write_HT_entry(uint32_t hash_value,
-                              IndexFileOffset offset) const
+                              IndexFileOffset offset)
 {
     LOG_ASSERT(hash_value >= 0 && hash_value < ht_size);
+    ht_chunk_count = 0;
     IndexFileOffset o = table_offset + hash_value * (fa.file_offset_size / 8);
     if (!(fseeko(fa.getFile(), o, SEEK_SET)==0 &&
           WriteIndexFileOffset(fa.getFile(), offset, fa.file_offset_size)))
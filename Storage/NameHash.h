@@ -52,7 +52,7 @@ public:
 
         /// Read from offset.
         /// @exception GenericException on error.
-        void read(FILE *f, int file_offset_size);
+        void read(FileReader &reader, int file_offset_size);
     };
 
     static const uint32_t anchor_size = sizeof(IndexFileOffset) + sizeof(uint32_t);
@@ -110,12 +110,22 @@ private:
     IndexFileOffset anchor;       // Where offset gets deposited in file
     uint32_t ht_size;   // Hash Table size (entries, not bytes)
     IndexFileOffset table_offset; // Start of HT in file
+    // Part of the HT read while iterating:
+    // ht_chunk[i] is the entry for hash value ht_chunk_start + i.
+    enum { ht_chunk_size = 256 };
+    IndexFileOffset ht_chunk[ht_chunk_size];
+    uint32_t ht_chunk_start, ht_chunk_count;
     /// Seek to hash_value, read offset.
     /// @exception GenericException on read error.
     void read_HT_entry(uint32_t hash_value, IndexFileOffset &offset);
+    /// Find the first used HT entry at or after hash_value,
+    /// reading the table in chunks of ht_chunk_size entries.
+    /// @return Returns false if there is none.
+    /// @exception GenericException on read error.
+    bool next_used_HT_entry(uint32_t &hash_value, IndexFileOffset &offset);
     /// Seek to hash_value, write offset.
     /// @exception GenericException on write error.
-    void write_HT_entry(uint32_t hash_value, IndexFileOffset offset) const;
+    void write_HT_entry(uint32_t hash_value, IndexFileOffset offset);
 };
 
 /// \@}
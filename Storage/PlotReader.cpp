@@ -9,6 +9,7 @@
 
 PlotReader::PlotReader(Index &index, double delta)
   : reader(index),
+    batches(reader),
     delta(delta),
     reader_data(0),
     N(0),
@@ -33,6 +34,7 @@ const RawValue::Data *PlotReader::find(const stdString &channel_name,
 {
     this->channel_name = channel_name;
     reader_data = reader.find(channel_name, start);
+    batches.reset();
     if (!reader_data)
         return 0;
     if (delta <= 0.0)
@@ -49,7 +51,7 @@ const RawValue::Data *PlotReader::find(const stdString &channel_name,
 #ifdef DEBUG_PLOTREAD
             printf("Skipping before-start sample.\n");
 #endif
-            reader_data = reader.next();
+            reader_data = batches.next();
             if (!reader_data) // There is no data >= *start.
             {
                 current = 0;
@@ -141,7 +143,7 @@ const RawValue::Data *PlotReader::fill_bin()
                 have_mini_maxi = true;
             }
         }   
-        reader_data = reader.next();
+        reader_data = batches.next();
     }
     // Options at this point:
     // 1) Found absolutely nothing (!have_initial_final)
@@ -241,6 +243,26 @@ const RawValue::Data *PlotReader::next()
     return fill_bin();
 }
 
+size_t PlotReader::nextBatch(size_t max_values, const RawValue::Data *&values)
+{
+    if (delta > 0.0)
+        return DataReader::nextBatch(max_values, values);
+    // Pass the raw batches on
+    size_t num = reader.nextBatch(max_values, values);
+    current = num > 0 ? reader.get() : 0;
+    return num;
+}
+
+void PlotReader::setBounds(const epicsTime *end, size_t max_samples)
+{
+    // Only pass the bounds on when returning the raw data.
+    // Otherwise the last bin still needs all of its raw samples.
+    if (delta <= 0.0)
+        reader.setBounds(end, max_samples);
+    else
+        reader.setBounds(0, 0);
+}
+
 const RawValue::Data *PlotReader::get() const
 {   return current; }
 
@@ -43,6 +43,8 @@ public:
     const RawValue::Data *find(const stdString &channel_name,
                                const epicsTime *start);
     const RawValue::Data *next();
+    size_t nextBatch(size_t max_values, const RawValue::Data *&values);
+    void setBounds(const epicsTime *end, size_t max_samples);
     const RawValue::Data *get() const;
     DbrType getType() const;
     DbrCount getCount() const;
@@ -51,6 +53,7 @@ public:
     bool changedInfo();
 private:
     RawDataReader reader;
+    DataBatchIterator batches; // steps through reader for the bins
     double delta;
 
     // Current value of reader
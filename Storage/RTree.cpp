@@ -1,5 +1,6 @@
 // Tools
 #include <MsgLogger.h>
+#include <MemoryBuffer.h>
 #include <BinIO.h>
 // Index
 #include "RTree.h"
@@ -27,22 +28,22 @@ void RTree::Datablock::write(FILE *f, int file_offset_size) const
                                (unsigned long) offset);
 }
 
-void RTree::Datablock::read(FILE *f, int file_offset_size)
+void RTree::Datablock::read(FileReader &reader, int file_offset_size)
 {
-    if (fseeko(f, offset, SEEK_SET))
-        throw GenericException(__FILE__, __LINE__, "fseeko(0x%08lX) failed",
-                               (unsigned long) offset);
     unsigned short len;
     char buf[300];
-    if (!(ReadIndexFileOffset(f, &next_ID, file_offset_size) &&
-          ReadIndexFileOffset(f, &data_offset, file_offset_size) &&
-          readShort(f, &len)))
+    size_t head = 2*IndexFileOffsetBytes(file_offset_size) + 2;
+    const uint8_t *c = (const uint8_t *) buf;
+    if (!reader.read(offset, buf, head))
         throw GenericException(__FILE__, __LINE__, "read failed @ 0x%lX",
                                (unsigned long)offset);
+    next_ID = GetIndexFileOffset(c, file_offset_size);
+    data_offset = GetIndexFileOffset(c, file_offset_size);
+    len = getShort(c);
     if (len >= sizeof(buf)-1)
         throw GenericException(__FILE__, __LINE__,
                                "Datablock filename exceeds buffer (%d)",len);
-    if (fread(buf, len, 1, f) != 1)
+    if (!reader.read(offset + head, buf, len))
         throw GenericException(__FILE__, __LINE__,
                                "Datablock filename read error @ 0x%lX",
                                (unsigned long) offset);
@@ -61,12 +62,11 @@ static void writeEpicsTime(FILE *f, const epicsTime &t)
         throw GenericException(__FILE__, __LINE__, "write error");
 }
 
-static void readEpicsTime(FILE *f, epicsTime &t)
+static void readEpicsTime(const uint8_t *&c, epicsTime &t)
 {
     epicsTimeStamp stamp;
-    if (! (readLong(f, (uint32_t *)&stamp.secPastEpoch) &&
-           readLong(f, (uint32_t *)&stamp.nsec)))
-        throw GenericException(__FILE__, __LINE__, "read error");
+    stamp.secPastEpoch = getLong(c);
+    stamp.nsec = getLong(c);
     if (stamp.nsec < 1000000000L)
     {
         t = stamp;
@@ -115,12 +115,11 @@ void RTree::Record::write(FILE *f, int file_offset_size) const
         throw GenericException(__FILE__, __LINE__, "write error");
 }
 
-void RTree::Record::read(FILE *f, int file_offset_size)
+void RTree::Record::read(const uint8_t *&c, int file_offset_size)
 {
-    readEpicsTime(f, start);
-    readEpicsTime(f, end);
-    if (!ReadIndexFileOffset(f, &child_or_ID, file_offset_size))
-        throw GenericException(__FILE__, __LINE__, "read error");
+    readEpicsTime(c, start);
+    readEpicsTime(c, end);
+    child_or_ID = GetIndexFileOffset(c, file_offset_size);
 }
 
 RTree::Node::Node(int M, bool leaf) : M(M)
@@ -180,18 +179,29 @@ void RTree::Node::write(FILE *f, int file_offset_size) const
         record[i].write(f, file_offset_size);
 }
 
-void RTree::Node::read(FILE *f, int file_offset_size)
+void RTree::Node::read(FileReader &reader, int file_offset_size)
 {
-    if (fseeko(f, offset, SEEK_SET))
-        throw GenericException(__FILE__, __LINE__, "fseeko(0x%08lX) failed",
+    // Read the whole node at once:
+    // isLeaf, parent, M * (start, end, child_or_ID)
+    size_t offset_bytes = IndexFileOffsetBytes(file_offset_size);
+    size_t size = 1 + offset_bytes + M*(16 + offset_bytes);
+    uint8_t local[2048];
+    MemoryBuffer<uint8_t> buffer;
+    uint8_t *mem = local;
+    if (size > sizeof(local))
+    {
+        buffer.reserve(size);
+        mem = buffer.mem();
+    }
+    if (!reader.read(offset, mem, size))
+        throw GenericException(__FILE__, __LINE__, "read failed @ 0x%08lX",
                                (unsigned long) offset);
-    uint8_t c;
-    if (! (readByte(f, &c) && ReadIndexFileOffset(f, &parent, file_offset_size)))
-        throw GenericException(__FILE__, __LINE__, "read failed");
-    isLeaf = c > 0;
+    const uint8_t *c = mem;
+    isLeaf = *(c++) > 0;
+    parent = GetIndexFileOffset(c, file_offset_size);
     int i;
     for (i=0; i<M; ++i)
-        record[i].read(f, file_offset_size);
+        record[i].read(c, file_offset_size);
 }
 
 bool RTree::Node::getInterval(epicsTime &start, epicsTime &end) const
@@ -245,12 +255,15 @@ void RTree::init(int M)
 void RTree::reattach()
 {
     uint32_t RTreeM;
-    if (!(fseeko(fa.getFile(), anchor, SEEK_SET)==0 &&
-          ReadIndexFileOffset(fa.getFile(), &root_offset, fa.file_offset_size)==true &&
-          readLong(fa.getFile(), &RTreeM) == true))
+    uint8_t buffer[8+4];
+    const uint8_t *c = buffer;
+    if (!fa.getReader().read(anchor, buffer,
+                             IndexFileOffsetBytes(fa.file_offset_size) + 4))
         throw GenericException(__FILE__, __LINE__,
                                "read error @ 0x%08lX",
                                (unsigned long) anchor);
+    root_offset = GetIndexFileOffset(c, fa.file_offset_size);
+    RTreeM = getLong(c);
     if (RTreeM < 1  ||  RTreeM > 100)
         throw GenericException(__FILE__, __LINE__,
                                "RTree::reattach: Suspicious RTree M %ld\n",
@@ -258,6 +271,34 @@ void RTree::reattach()
     M = RTreeM;
 }
 
+bool RTree::refresh()
+{
+    IndexFileOffset old_root = root_offset;
+    reattach();
+    if (root_offset == old_root)
+    {
+        Node cached(M, true);
+        cached.offset = root_offset;
+        // All searches start at the root, so nothing is cached without it
+        if (!node_cache.find(cached))
+            return false;
+        // Any data added below the root also updates its records
+        Node current(M, true);
+        current.offset = root_offset;
+        current.read(fa.getReader(), fa.file_offset_size);
+        int i;
+        for (i=0; i<M; ++i)
+            if (current.record[i].child_or_ID != cached.record[i].child_or_ID  ||
+                current.record[i].start != cached.record[i].start  ||
+                current.record[i].end != cached.record[i].end)
+                break;
+        if (i >= M  &&  current.isLeaf == cached.isLeaf)
+            return false;
+    }
+    node_cache.clear();
+    return true;
+}
+
 bool RTree::getInterval(epicsTime &start, epicsTime &end)
 {
     Node node(M, true);
@@ -272,7 +313,7 @@ bool RTree::searchDatablock(const epicsTime &start, Node &node, int &i,
     if (!search(start, node, i))
         return false;
     block.offset = node.record[i].child_or_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -281,7 +322,7 @@ bool RTree::getFirstDatablock(Node &node, int &i, Datablock &block) const
     if (!getFirst(node, i))
         return false;
     block.offset = node.record[i].child_or_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -290,7 +331,7 @@ bool RTree::getLastDatablock(Node &node, int &i, Datablock &block) const
     if (!getLast(node, i))
         return false;
     block.offset = node.record[i].child_or_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -299,7 +340,7 @@ bool RTree::getNextChainedBlock(Datablock &block) const
     if (block.next_ID == 0)
         return false;
     block.offset = block.next_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -308,7 +349,7 @@ bool RTree::getPrevDatablock(Node &node, int &i, Datablock &block) const
     if (!prev(node, i))
         return false;
     block.offset = node.record[i].child_or_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -317,7 +358,7 @@ bool RTree::getNextDatablock(Node &node, int &i, Datablock &block) const
     if (!next(node, i))
         return false;
     block.offset = node.record[i].child_or_ID;
-    block.read(fa.getFile(), fa.file_offset_size);
+    block.read(fa.getReader(), fa.file_offset_size);
     return true;
 }
 
@@ -344,7 +385,7 @@ bool RTree::updateLastDatablock(const epicsTime &start,
         //     hidden part 15..20 is inserted again, which ends up as a NOP.
         Datablock block;
         block.offset = node.record[i].child_or_ID;
-        block.read(fa.getFile(), fa.file_offset_size);
+        block.read(fa.getReader(), fa.file_offset_size);
         // Is this the one and only block under the last node
         // and does it point to offset/filename? 
         if (block.next_ID == 0 &&
@@ -388,7 +429,7 @@ void RTree::makeDot(const char *filename)
     fprintf(dot, "digraph RTree\n");
     fprintf(dot, "{\n");
     fprintf(dot, "\tnode [shape = record, height=.1];\n");
-    make_node_dot(dot, fa.getFile(), root_offset);
+    make_node_dot(dot, fa.getReader(), root_offset);
     fprintf(dot, "}\n");
     fclose(dot);
 }
@@ -421,7 +462,7 @@ void RTree::read_node(Node &node) const
         return;
     }
     ++cache_misses;
-    node.read(fa.getFile(), fa.file_offset_size);
+    node.read(fa.getReader(), fa.file_offset_size);
     node_cache.add(node);
 }
 
@@ -491,14 +532,14 @@ void RTree::self_test_node(unsigned long &nodes, unsigned long &records,
     }       
 }
 
-void RTree::make_node_dot(FILE *dot, FILE *f, IndexFileOffset node_offset)
+void RTree::make_node_dot(FILE *dot, FileReader &reader, IndexFileOffset node_offset)
 {
     Datablock datablock;
     stdString txt1, txt2;
     int i;
     Node node(M, true);
     node.offset = node_offset;
-    node.read(f, fa.file_offset_size);
+    node.read(reader, fa.file_offset_size);
     fprintf(dot, "\tnode%ld [ label=\"", (unsigned long)node.offset);
     for (i=0; i<M; ++i)
     {
@@ -523,7 +564,7 @@ void RTree::make_node_dot(FILE *dot, FILE *f, IndexFileOffset node_offset)
                         (unsigned long)datablock.offset);
             while (datablock.offset)
             {
-                datablock.read(f, fa.file_offset_size);
+                datablock.read(reader, fa.file_offset_size);
                 fprintf(dot, "\tid%lu "
                         "[ label=\"'%s' \\r@ 0x%lX \\r\",style=filled ];\n",
                         (unsigned long)datablock.offset,
@@ -551,7 +592,7 @@ void RTree::make_node_dot(FILE *dot, FILE *f, IndexFileOffset node_offset)
         for (i=0; i<M; ++i)
         {
             if (node.record[i].child_or_ID)
-                make_node_dot(dot, f, node.record[i].child_or_ID);
+                make_node_dot(dot, reader, node.record[i].child_or_ID);
         }
     }
 }
@@ -770,7 +811,7 @@ bool RTree::add_block_to_record(const Node &node, int i,
     while (block.next_ID) // run over blocks under record
     {
         block.offset = block.next_ID;
-        block.read(fa.getFile(), fa.file_offset_size);
+        block.read(fa.getReader(), fa.file_offset_size);
         if (block.data_offset == data_offset &&
             block.data_filename == data_filename)
             return false; // found an existing datablock
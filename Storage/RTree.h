@@ -68,7 +68,7 @@ public:
         /** @exception GenericException on write error */
         void write(FILE *f, int file_offset_size) const;
         /** @exception GenericException on read error */
-        void read(FILE *f, int file_offset_size);
+        void read(FileReader &reader, int file_offset_size);
     private:
         PROHIBIT_DEFAULT_COPY(Datablock);
     };
@@ -82,8 +82,8 @@ public:
         IndexFileOffset child_or_ID; // data block ID for leaf node; 0 if unused
         /** @exception GenericException on write error */
         void write(FILE *f, int file_offset_size) const;
-        /** @exception GenericException on read error */
-        void read(FILE *f, int file_offset_size);
+        /** Decode from memory, advancing c */
+        void read(const uint8_t *&c, int file_offset_size);
     };
 
     class Node
@@ -108,7 +108,7 @@ public:
         /** Read from file at offset (needs to be set beforehand)
          *  @exception GenericException on read error
          */
-        void read(FILE *f, int file_offset_size);
+        void read(FileReader &reader, int file_offset_size);
 
         /** Obtain interval covered by this node
           * @return True if there is a valid interval, false if empty.
@@ -141,6 +141,15 @@ public:
       */
     void reattach();
 
+    /** Re-read the root pointer of an attached tree.
+      *
+      * Drops the node cache if the root moved or changed since it
+      * was read, as it does when ArchiveEngine adds data to the tree.
+      * @return True if the tree changed.
+      * @exception GenericException on read error.
+      */
+    bool refresh();
+
     /** The 'M' value, i.e. Node size, of this RTree. */
     int getM() const
     { return M; }
@@ -276,7 +285,7 @@ private:
                         IndexFileOffset n, IndexFileOffset p,
                         epicsTime start, epicsTime end);
     
-    void make_node_dot(FILE *dot, FILE *f, IndexFileOffset node_offset);
+    void make_node_dot(FILE *dot, FileReader &reader, IndexFileOffset node_offset);
 
     bool search(const epicsTime &start, Node &node, int &i) const;
 
@@ -282,5 +282,63 @@ TEST_CASE update_test()
 
     TEST_OK;
 }
+
+// Add a data block for time t...t+1 to the channel "test" of the index
+static void add_block(const char *index_name, int t)
+{
+    IndexFile index(3);
+    stdString directory;
+    index.open(index_name, false);
+    AutoPtr<RTree> tree(index.addChannel("test", directory));
+    epicsTime start, end;
+    char txt[20];
+    sprintf(txt, "%d", t);
+    string2epicsTime(txt, start);
+    sprintf(txt, "%d", t+1);
+    string2epicsTime(txt, end);
+    tree->insertDatablock(start, end, t, "file");
+    tree = 0;
+    index.close();
+}
+
+TEST_CASE refresh_test()
+{
+    TEST_DELETE_FILE("test/refresh.tst");
+    try
+    {
+        add_block("test/refresh.tst", 10);
+        IndexFile index;
+        stdString directory;
+        index.open("test/refresh.tst");
+        AutoPtr<RTree> tree(index.getTree("test", directory));
+        TEST(tree);
+        RTree::Node node(tree->getM(), true);
+        RTree::Datablock block;
+        int idx;
+        TEST(tree->getLastDatablock(node, idx, block));
+        TEST(block.data_offset == 10);
+        TEST(tree->refresh() == false);
+        // Blocks added through another index fill the root, then split it
+        int t;
+        for (t=20; t<100; t+=10)
+        {
+            add_block("test/refresh.tst", t);
+            TEST(tree->refresh() == true);
+            TEST(tree->getLastDatablock(node, idx, block));
+            TEST(block.data_offset == (IndexFileOffset) t);
+            TEST(tree->refresh() == false);
+        }
+        unsigned long nodes, records;
+        TEST(tree->selfTest(nodes, records));
+        tree = 0;
+        index.close();
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        FAIL("Exception");
+    }
+    TEST_OK;
+}
 #endif
 
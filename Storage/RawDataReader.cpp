@@ -1,5 +1,7 @@
 // RawDataReader.cpp
 
+// System
+#include <string.h>
 // Tools
 #include "MsgLogger.h"
 #include "Filename.h"
@@ -19,7 +21,14 @@ RawDataReader::RawDataReader(Index &index)
           ctrl_info_changed(false),
           period(0.0),
           raw_value_size(0),
-          val_idx(0)
+          val_idx(0),
+          read_ahead(default_read_ahead),
+          window_start(0),
+          window_size(0),
+          has_end(false),
+          max_samples(0),
+          num_samples(0),
+          bounds_met(false)
 {}
 
 RawDataReader::~RawDataReader()
@@ -32,10 +41,19 @@ RawDataReader::~RawDataReader()
 const RawValue::Data *RawDataReader::find(const stdString &channel_name,
                                           const epicsTime *start)
 {
-    this->channel_name = channel_name;
-    // Get tree
+    // Get tree, unless we already have the one of this channel:
+    // Keeping it also keeps its node cache for repeated queries,
+    // until refresh() finds that data was added to the tree.
     // TODO: getTree(... , start) for better ListIndex
-    tree = index.getTree(channel_name, directory);
+    if (!tree  ||  this->channel_name != channel_name)
+    {
+        this->channel_name = channel_name;
+        tree = index.getTree(channel_name, directory);
+    }
+    else
+        tree->refresh();
+    num_samples = 0;
+    bounds_met = false;
     if (! tree)
         return 0; // Channel not found
     try
@@ -71,9 +89,9 @@ const RawValue::Data *RawDataReader::find(const stdString &channel_name,
         // Get the buffer for that data block
         getHeader(directory, datablock.data_filename, datablock.data_offset);
         if (start)
-            return findSample(*start);
+            return checkBounds(findSample(*start));
         else
-            return findSample(node->record[rec_idx].start);
+            return checkBounds(findSample(node->record[rec_idx].start));
     }
     catch (GenericException &e)
     {  // Add channel name to the message
@@ -82,8 +100,118 @@ const RawValue::Data *RawDataReader::find(const stdString &channel_name,
     }
 }
 
-// Read next sample, the one to which val_idx points.
+const RawValue::Data *RawDataReader::seek(const epicsTime &time)
+{
+    if (!(tree  &&  header  &&  valid_datablock  &&
+          node->record[rec_idx].start <= time))
+        return find(channel_name, &time);
+    // Beyond the current block, step ahead to the last block that starts
+    // before-or-at time, like searchDatablock() but without descending
+    // from the root.
+    RTree::Node next_node(*node);
+    int next_idx = rec_idx;
+    RTree::Datablock next_block;
+    size_t steps = 0;
+    while (time > node->record[rec_idx].end  &&
+           tree->getNextDatablock(next_node, next_idx, next_block)  &&
+           next_node.record[next_idx].start <= time)
+    {
+        if (++steps > seek_blocks)
+            return find(channel_name, &time);
+        *node = next_node;
+        rec_idx = next_idx;
+        datablock.offset = next_block.offset;
+        datablock.next_ID = next_block.next_ID;
+        datablock.data_offset = next_block.data_offset;
+        datablock.data_filename = next_block.data_filename;
+    }
+    if (steps > 0)
+        getHeader(directory, datablock.data_filename, datablock.data_offset);
+    // Binary search within the current block
+    const RawValue::Data *value = findSample(time);
+    if (value  &&  RawValue::getTime(value) <= time)
+        return value;
+    // else: Block didn't start with a sample before time after all.
+    return find(channel_name, &time);
+}
+
+void RawDataReader::setBounds(const epicsTime *end, size_t max_samples)
+{
+    has_end = end != 0;
+    if (end)
+        this->end = *end;
+    this->max_samples = max_samples;
+}
+
+void RawDataReader::setReadAhead(size_t bytes)
+{
+    read_ahead = bytes;
+    window_size = 0;
+}
+
 const RawValue::Data *RawDataReader::next()
+{
+    // Once the bounds are met, there's no need to read on,
+    // let alone to refresh the last data file at the end of the RTree.
+    if (bounds_met)
+        return 0;
+    return checkBounds(readNext());
+}
+
+size_t RawDataReader::nextBatch(size_t max_values, const RawValue::Data *&values)
+{
+    values = 0;
+    if (bounds_met  ||  max_values == 0)
+        return 0;
+    // The first value goes the way of next(),
+    // which moves on to the next data block when needed.
+    if (!checkBounds(readNext()))
+        return 0;
+    size_t idx = val_idx - 1;
+    if (idx < window_start  ||  idx >= window_start + window_size)
+    {   // Not read via the window
+        values = data;
+        return 1;
+    }
+    const char *first = window.mem() + (idx - window_start) * raw_value_size;
+    const RawValue::Data *value = (const RawValue::Data *) first;
+    size_t num = 1;
+    // Add the following samples of the window, stopping where
+    // readNext() would leave the block or the bounds are met.
+    while (num < max_values  &&  !bounds_met  &&
+           val_idx < window_start + window_size)
+    {
+        value = (const RawValue::Data *) (first + num * raw_value_size);
+        if (valid_datablock  &&
+            RawValue::getTime(value) > node->record[rec_idx].end)
+            break;
+        checkBounds(value);
+        ++val_idx;
+        ++num;
+    }
+    // get() returns the last value of the batch
+    if (num > 1)
+        memcpy(data, first + (num-1) * raw_value_size, raw_value_size);
+    values = (const RawValue::Data *) first;
+    return num;
+}
+
+// Counts the values returned by find() or next(),
+// marking when the bounds set by setBounds() are met.
+const RawValue::Data *RawDataReader::checkBounds(const RawValue::Data *value)
+{
+    if (value  &&  !RawValue::isInfo(value))
+    {
+        ++num_samples;
+        if ((max_samples > 0  &&  num_samples >= max_samples)  ||
+            (has_end  &&  RawValue::getTime(value) >= end))
+            bounds_met = true;
+    }
+    return value;
+}
+
+// Read next sample, the one to which val_idx points.
+const RawValue::Data *RawDataReader::readNext()
 {
     if (!header)
         throw GenericException(__FILE__, __LINE__,
@@ -113,7 +241,7 @@ const RawValue::Data *RawDataReader::next()
 #           ifdef DEBUG_DATAREADER
             printf("- findSample gave sample<start, skipping that one\n");
 #           endif
-            return next();   
+            return readNext();   
         }
         // TODO: For better ListIndex functionality,
         //       ask index again with proper start time,
@@ -137,6 +265,7 @@ const RawValue::Data *RawDataReader::next()
         // Refresh datafile and header.
         header->datafile->reopen();
         header->read(header->offset);
+        window_size = 0;
         // Need to look for next header (w/o asking RTree) ?
         if (val_idx >= header->data.num_samples)
         {
@@ -161,10 +290,7 @@ const RawValue::Data *RawDataReader::next()
 #       endif
     }
     // Read 'val_idx' sample in current block.
-    FileOffset offset = header->offset
-        + sizeof(DataHeader::DataHeaderData) + val_idx * raw_value_size;
-    RawValue::read(dbr_type, dbr_count, raw_value_size, data,
-                   header->datafile, offset);
+    readSample(val_idx);
     // If we still have an RTree entry: Are we within bounds?
     // This is because the DataFile might contain the current sample
     // in the current buffer, but the RTree already has a different
@@ -173,7 +299,7 @@ const RawValue::Data *RawDataReader::next()
         RawValue::getTime(data) > node->record[rec_idx].end)
     {   // Recurse after marking end of samples in the current datafile
         val_idx = header->data.num_samples;
-        return next();
+        return readNext();
         // TODO: Handle this case:
         // Master only knows about e.g. 10 samples in last block
         // Meanwhile, there are 30 samples.
@@ -184,6 +310,41 @@ const RawValue::Data *RawDataReader::next()
     return data;
 }
 
+// Read sample 'idx' of the current block into data,
+// from the read-ahead window which is refilled starting at idx
+// when it doesn't hold that sample.
+// The window holds the samples converted from their disk format,
+// so nextBatch() can return them in place.
+void RawDataReader::readSample(size_t idx)
+{
+    FileOffset offset0 = header->offset + sizeof(DataHeader::DataHeaderData);
+    size_t num = read_ahead / raw_value_size;
+    if (num <= 1  ||  idx >= header->data.num_samples)
+    {
+        RawValue::read(dbr_type, dbr_count, raw_value_size, data,
+                       header->datafile, offset0 + idx * raw_value_size);
+        return;
+    }
+    if (idx < window_start  ||  idx >= window_start + window_size)
+    {
+        if (num > header->data.num_samples - idx)
+            num = header->data.num_samples - idx;
+        window_size = 0; // in case the read fails
+        window.reserve(num * raw_value_size);
+        RawValue::readBlock(raw_value_size, num, window.mem(),
+                            header->datafile, offset0 + idx * raw_value_size);
+        for (size_t i = 0; i < num; ++i)
+            RawValue::fromDisk(dbr_type, dbr_count,
+                               (RawValue::Data *) (window.mem() + i * raw_value_size),
+                               header->datafile,
+                               offset0 + (idx + i) * raw_value_size);
+        window_start = idx;
+        window_size = num;
+    }
+    memcpy(data, window.mem() + (idx - window_start) * raw_value_size,
+           raw_value_size);
+}
+
 const RawValue::Data *RawDataReader::get() const
 {   return data; }
 
@@ -260,6 +421,7 @@ void RawDataReader::getHeader(const stdString &dirname,
         }
         // Switch to new header. AutoPtr will release previous header.
         header = new_header;
+        window_size = 0;
         // If we never allocated a RawValue, or the type changed...
         if (!data ||
             header->data.dbr_type  != dbr_type  ||
@@ -303,7 +465,7 @@ const RawValue::Data *RawDataReader::findSample(const epicsTime &start)
         printf("- Using the first sample in the buffer\n");
 #endif
         val_idx = 0;
-        return next();
+        return readNext();
     }
     // Binary search for sample before-or-at start in current header
     epicsTime stamp;
@@ -329,7 +491,7 @@ const RawValue::Data *RawDataReader::findSample(const epicsTime &start)
             if (stamp > start)
             {
                 val_idx = low;
-                return next();
+                return readNext();
             }
             // else: val_idx == high is good & already read into data
             break;
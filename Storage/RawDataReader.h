@@ -6,6 +6,7 @@
 // Tools
 #include <ToolsConfig.h>
 #include <AutoPtr.h>
+#include <MemoryBuffer.h>
 // Storage
 #include "DataReader.h"
 
@@ -21,12 +22,43 @@ public:
     virtual const RawValue::Data *find(const stdString &channel_name,
                                        const epicsTime *start);
     virtual const RawValue::Data *next();
+
+    /// Returns the samples of the read-ahead window in place,
+    /// without copying them, see setReadAhead().
+    virtual size_t nextBatch(size_t max_values, const RawValue::Data *&values);
+    virtual void setBounds(const epicsTime *end, size_t max_samples);
     virtual const RawValue::Data *get() const;
     virtual DbrType getType() const;
     virtual DbrCount getCount() const;
     virtual const CtrlInfo &getInfo() const;
     virtual bool changedType();
     virtual bool changedInfo();
+
+    /// Move on to the sample before-or-at time.
+    ///
+    /// Like find() for the current channel, but if time is within
+    /// the current data block or up to seek_blocks blocks after it,
+    /// the reader steps ahead to that block instead of walking
+    /// the RTree again from the root.
+    /// Meant for a sequence of increasing times after find().
+    /// @return Sample before-or-at time, a sample after time if
+    ///         there is none before, or 0.
+    /// @exception GenericException on error.
+    const RawValue::Data *seek(const epicsTime &time);
+
+    /// Read up to this many bytes of samples at once.
+    ///
+    /// next() then serves the following samples of the current
+    /// data block from memory, reading the data file once
+    /// per window instead of once per sample.
+    /// 0 (or less than one sample) reads every sample on its own.
+    void setReadAhead(size_t bytes);
+
+    /// Read-ahead window of a new reader, see setReadAhead().
+    static const size_t default_read_ahead = 64*1024;
+
+    /// Blocks that seek() steps ahead before it uses find().
+    static const size_t seek_blocks = 4;
 private:
     Index                &index;
     stdString            directory;
@@ -48,9 +80,25 @@ private:
     AutoPtr<class DataHeader> header;
     size_t val_idx; // current index in data buffer
 
+    // Read-ahead, see setReadAhead()
+    size_t read_ahead;
+    MemoryBuffer<char> window; // samples of the current header
+    size_t window_start; // index of the first sample in window
+    size_t window_size;  // samples in window, 0 for none
+
+    // Bounds, see setBounds()
+    bool has_end;
+    epicsTime end;
+    size_t max_samples;
+    size_t num_samples; // values returned since find()
+    bool bounds_met;
+
     void getHeader(const stdString &dirname, const stdString &basename,
                    FileOffset offset);
     const RawValue::Data *findSample(const epicsTime &start);
+    const RawValue::Data *readNext();
+    void readSample(size_t idx);
+    const RawValue::Data *checkBounds(const RawValue::Data *value);
 };
 
 /// @}
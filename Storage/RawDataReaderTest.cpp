@@ -149,3 +149,206 @@ TEST_CASE DualRawDataReaderTest()
     TEST_OK;
 }
 
+
+// Compare seek() to find() for the time of every sample
+// and for a time just after it.
+static size_t seek_test(const stdString &index_name, const stdString &channel_name)
+{
+    size_t num = 0;
+    try
+    {
+        IndexFile index;
+        index.open(index_name);
+        RawDataReader reader(index), seeker(index);
+        const RawValue::Data *value = reader.find(channel_name, 0);
+        epicsTime time;
+        if (value)
+        {
+            time = RawValue::getTime(value);
+            seeker.find(channel_name, &time);
+        }
+        while (value)
+        {
+            time = RawValue::getTime(value);
+            const RawValue::Data *found = seeker.seek(time);
+            if (!found  ||  RawValue::getTime(found) != time)
+                return 0;
+            time += 0.000001;
+            found = seeker.seek(time);
+            if (!found  ||  RawValue::getTime(found) > time)
+                return 0;
+            ++num;
+            value = reader.next();
+        }
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        return 0;
+    }
+    return num;
+}
+
+// Read with bounds, counting the values (not the 'info' records)
+// returned until next() stops.
+static size_t bounds_test(const stdString &index_name, const stdString &channel_name,
+                          const epicsTime *end, size_t max_samples)
+{
+    size_t num = 0;
+    try
+    {
+        IndexFile index;
+        index.open(index_name);
+        RawDataReader reader(index);
+        reader.setBounds(end, max_samples);
+        const RawValue::Data *value = reader.find(channel_name, 0);
+        while (value)
+        {
+            if (!RawValue::isInfo(value))
+                ++num;
+            value = reader.next();
+        }
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        return 0;
+    }
+    return num;
+}
+
+TEST_CASE RawDataReaderSeekTest()
+{
+    TEST(seek_test("../DemoData/index", "fred") == 87);
+    TEST(DataFile::clear_cache() == 0);
+    TEST_OK;
+}
+
+TEST_CASE RawDataReaderBoundsTest()
+{
+    TEST(bounds_test("../DemoData/index", "fred", 0, 0) == 87);
+    TEST(bounds_test("../DemoData/index", "fred", 0, 10) == 10);
+    TEST(bounds_test("../DemoData/index", "fred", 0, 1) == 1);
+
+    // Stops right after the first value at-or-after end
+    epicsTime end;
+    TEST(string2epicsTime("03/23/2004 10:50:42.400561000", end));
+    TEST(bounds_test("../DemoData/index", "fred", &end, 0) ==
+         read_test("../DemoData/index", "fred", 0, &end) + 1);
+    TEST(bounds_test("../DemoData/index", "fred", &end, 5) == 5);
+    TEST(DataFile::clear_cache() == 0);
+    TEST_OK;
+}
+
+// Read all samples with the given read-ahead, as text.
+static size_t read_ahead_test(const stdString &index_name, const stdString &channel_name,
+                              size_t read_ahead, stdString &all)
+{
+    stdString text;
+    size_t num = 0;
+    all.assign(0, 0);
+    try
+    {
+        IndexFile index;
+        index.open(index_name);
+        RawDataReader reader(index);
+        reader.setReadAhead(read_ahead);
+        const RawValue::Data *value = reader.find(channel_name, 0);
+        while (value)
+        {
+            ++num;
+            reader.toString(text);
+            all += text;
+            all += "\n";
+            value = reader.next();
+        }
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        return 0;
+    }
+    return num;
+}
+
+TEST_CASE RawDataReaderReadAheadTest()
+{
+    stdString single, small, large;
+    TEST(read_ahead_test("../DemoData/index", "fred", 0, single) == 87);
+    // window of a few samples, refilled within a block
+    TEST(read_ahead_test("../DemoData/index", "fred", 100, small) == 87);
+    TEST(read_ahead_test("../DemoData/index", "fred",
+                         RawDataReader::default_read_ahead, large) == 87);
+    TEST(small == single);
+    TEST(large == single);
+    TEST(DataFile::clear_cache() == 0);
+    TEST_OK;
+}
+
+// Read all values via nextBatch(max_values), formatted like read_ahead_test.
+static size_t batch_test(const stdString &index_name, const stdString &channel_name,
+                         size_t max_values, size_t &batches, stdString &all)
+{
+    stdString text;
+    size_t num = 0;
+    batches = 0;
+    all.assign(0, 0);
+    try
+    {
+        IndexFile index;
+        index.open(index_name);
+        RawDataReader reader(index);
+        const RawValue::Data *value = reader.find(channel_name, 0);
+        if (!value)
+            return 0;
+        reader.toString(text);
+        all += text;
+        all += "\n";
+        ++num;
+        size_t size, n, i;
+        while ((n = reader.nextBatch(max_values, value)) > 0)
+        {
+            if (n > max_values)
+                return 0;
+            ++batches;
+            size = RawValue::getSize(reader.getType(), reader.getCount());
+            for (i=0; i<n; ++i)
+            {
+                RawValue::toString(text, reader.getType(), reader.getCount(),
+                                   (const RawValue::Data *)((const char *)value + i*size),
+                                   &reader.getInfo());
+                all += text;
+                all += "\n";
+                ++num;
+            }
+            // get() must be the last value of the batch
+            reader.toString(text);
+            if (all.substr(all.length() - text.length() - 1, text.length()) != text)
+                return 0;
+        }
+    }
+    catch (GenericException &e)
+    {
+        printf("Exception:\n%s\n", e.what());
+        return 0;
+    }
+    return num;
+}
+
+TEST_CASE RawDataReaderBatchTest()
+{
+    stdString single, batched;
+    size_t batches;
+    TEST(read_ahead_test("../DemoData/index", "fred",
+                         RawDataReader::default_read_ahead, single) == 87);
+    TEST(batch_test("../DemoData/index", "fred", 1, batches, batched) == 87);
+    TEST(batched == single);
+    TEST(batches == 86);
+    TEST(batch_test("../DemoData/index", "fred", 10, batches, batched) == 87);
+    TEST(batched == single);
+    TEST(batches < 86);
+    TEST(batch_test("../DemoData/index", "fred", 1000, batches, batched) == 87);
+    TEST(batched == single);
+    TEST(DataFile::clear_cache() == 0);
+    TEST_OK;
+}
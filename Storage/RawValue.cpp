@@ -587,14 +587,23 @@ void RawValue::show(FILE *file,
 void RawValue::read(DbrType type, DbrCount count, size_t size, Data *value,
                     DataFile *datafile, FileOffset offset)
 {
-    if (fseek(datafile->file, offset, SEEK_SET) != 0 ||
-        (FileOffset) ftell(datafile->file) != offset   ||
-        fread(value, size, 1, datafile->file) != 1)
+    readBlock(size, 1, value, datafile, offset);
+    fromDisk(type, count, value, datafile, offset);
+}
+
+void RawValue::readBlock(size_t size, size_t num, void *buffer,
+                         DataFile *datafile, FileOffset offset)
+{
+    if (!datafile->readAt(offset, buffer, size * num))
         throw GenericException(__FILE__, __LINE__,
                                "Data read error in '%s' @ 0x%08lX",
                                datafile->getFilename().c_str(),
                                (unsigned long)offset);
-    
+}
+
+void RawValue::fromDisk(DbrType type, DbrCount count, Data *value,
+                        DataFile *datafile, FileOffset offset)
+{
     SHORTFromDisk(value->status);
     SHORTFromDisk(value->severity);
     epicsTimeStampFromDisk(value->stamp);
@@ -172,6 +172,22 @@ public:
     static void read(DbrType type, DbrCount count,
                      size_t size, Data *value,
                      class DataFile *datafile, FileOffset offset);
+
+    /// Read num consecutive values from binary file as they are on disk.
+    ///
+    /// One read for all values, each of them still needs fromDisk().
+    ///
+    /// @exception GenericException on error.
+    static void readBlock(size_t size, size_t num, void *buffer,
+                          class DataFile *datafile, FileOffset offset);
+
+    /// Convert a value read by readBlock() to the memory format, in place.
+    ///
+    /// datafile and offset are only used for error messages.
+    ///
+    /// @exception GenericException on unknown type.
+    static void fromDisk(DbrType type, DbrCount count, Data *value,
+                         class DataFile *datafile, FileOffset offset);
     
     /// Write a value to binary file.
     ///
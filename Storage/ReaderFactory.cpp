@@ -6,9 +6,9 @@
 #include "AverageReader.h"
 #include "LinearReader.h"
 
-const char *ReaderFactory::toString(How how, double delta)
+stdString ReaderFactory::toString(How how, double delta)
 {
-    static char buf[100];
+    char buf[100];
     switch (how)
     {
         case Raw:
@@ -43,7 +43,7 @@ DataReader *ReaderFactory::create(Index &index, How how, double delta)
     catch (...)
     {
         throw GenericException(__FILE__, __LINE__, "Cannot create reader for %s",
-                               toString(how, delta));
+                               toString(how, delta).c_str());
     }
 }
 
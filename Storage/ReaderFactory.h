@@ -29,9 +29,7 @@ public:
     ///
     /// The result is suitable for display ala
     /// "Method: ...".
-    /// The result is held in a static char buffer,
-    /// beware of other threads calling toString.
-    static const char *toString(How how, double delta);
+    static stdString toString(How how, double delta);
     
     /// Create a DataReader.
     static DataReader *create(Index &index, How how, double delta);
@@ -12,6 +12,8 @@
 extern TEST_CASE AverageReaderTest();
 // Unit DataFileTest:
 extern TEST_CASE test_data_file();
+extern TEST_CASE test_data_file_per_thread();
+extern TEST_CASE test_data_file_mapping();
 // Unit DataWriterTest:
 extern TEST_CASE data_writer_test();
 extern TEST_CASE data_writer_readback();
@@ -30,9 +32,14 @@ extern TEST_CASE PlotReaderTest();
 extern TEST_CASE fill_tests();
 extern TEST_CASE dump_blocks();
 extern TEST_CASE update_test();
+extern TEST_CASE refresh_test();
 // Unit RawDataReaderTest:
 extern TEST_CASE RawDataReaderTest();
 extern TEST_CASE DualRawDataReaderTest();
+extern TEST_CASE RawDataReaderSeekTest();
+extern TEST_CASE RawDataReaderBoundsTest();
+extern TEST_CASE RawDataReaderReadAheadTest();
+extern TEST_CASE RawDataReaderBatchTest();
 // Unit RawValueTest:
 extern TEST_CASE RawValue_format();
 extern TEST_CASE RawValue_compare();
@@ -91,6 +98,24 @@ int main(int argc, const char *argv[])
             else
                 printf("THERE WERE ERRORS!\n");
        }
+       if (single_case==0  ||  strcmp(single_case, "test_data_file_per_thread")==0)
+       {
+            ++run;
+            printf("\ntest_data_file_per_thread:\n");
+            if (test_data_file_per_thread())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+       if (single_case==0  ||  strcmp(single_case, "test_data_file_mapping")==0)
+       {
+            ++run;
+            printf("\ntest_data_file_mapping:\n");
+            if (test_data_file_mapping())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
     }
     if (single_unit==0  ||  strcmp(single_unit, "DataWriterTest")==0)
     {
@@ -239,6 +264,15 @@ int main(int argc, const char *argv[])
             else
                 printf("THERE WERE ERRORS!\n");
        }
+       if (single_case==0  ||  strcmp(single_case, "refresh_test")==0)
+       {
+            ++run;
+            printf("\nrefresh_test:\n");
+            if (refresh_test())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
     }
     if (single_unit==0  ||  strcmp(single_unit, "RawDataReaderTest")==0)
     {
@@ -264,6 +298,42 @@ int main(int argc, const char *argv[])
             else
                 printf("THERE WERE ERRORS!\n");
        }
+       if (single_case==0  ||  strcmp(single_case, "RawDataReaderSeekTest")==0)
+       {
+            ++run;
+            printf("\nRawDataReaderSeekTest:\n");
+            if (RawDataReaderSeekTest())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+       if (single_case==0  ||  strcmp(single_case, "RawDataReaderBoundsTest")==0)
+       {
+            ++run;
+            printf("\nRawDataReaderBoundsTest:\n");
+            if (RawDataReaderBoundsTest())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+       if (single_case==0  ||  strcmp(single_case, "RawDataReaderReadAheadTest")==0)
+       {
+            ++run;
+            printf("\nRawDataReaderReadAheadTest:\n");
+            if (RawDataReaderReadAheadTest())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+       if (single_case==0  ||  strcmp(single_case, "RawDataReaderBatchTest")==0)
+       {
+            ++run;
+            printf("\nRawDataReaderBatchTest:\n");
+            if (RawDataReaderBatchTest())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
     }
     if (single_unit==0  ||  strcmp(single_unit, "RawValueTest")==0)
     {
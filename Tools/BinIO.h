@@ -31,6 +31,28 @@ inline bool writeByte(FILE *f, uint8_t byte)
 inline bool readByte(FILE *f, uint8_t *byte)
 {   return fread(byte, 1, 1, f) == 1; }
 
+/// Get value with fixed byte order from memory, advancing c
+inline uint32_t getLong(const uint8_t *&c)
+{
+    uint32_t value =
+        ((uint32_t)c[0]) << 24 |
+        ((uint32_t)c[1]) << 16 |
+        ((uint32_t)c[2]) <<  8 |
+         (uint32_t)c[3];
+    c += 4;
+    return value;
+}
+
+/// Get value with fixed byte order from memory, advancing c
+inline uint16_t getShort(const uint8_t *&c)
+{
+    uint16_t value =
+        ((uint16_t)c[0]) <<  8 |
+         (uint16_t)c[1];
+    c += 2;
+    return value;
+}
+
 /// @}
 
 #endif
@@ -0,0 +1,283 @@
+// FileReader.cpp: implementation of the FileReader classes.
+
+// System
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+// C++
+#include <atomic>
+#include <mutex>
+#include <set>
+// Tools
+#include "AutoPtr.h"
+#include "FileReader.h"
+#include "MappedFile.h"
+
+// Counters per method: reads, bytes, then the read sizes
+enum { count_reads, count_bytes, count_sizes,
+       num_counts = count_sizes + FileReader::size_buckets };
+typedef size_t Counts[FileReader::num_methods][num_counts];
+
+// Read statistics of one thread.
+// Only the thread itself updates them, so threads reading at the same
+// time don't all write the same cache line. getStats() adds them up.
+class ThreadStats
+{
+public:
+    ThreadStats();
+    ~ThreadStats();
+
+    void add(int method, int counter, size_t n)
+    {
+        std::atomic<size_t> &count = counts[method][counter];
+        count.store(count.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+    void addTo(Counts &sum) const;
+
+private:
+    std::atomic<size_t> counts[FileReader::num_methods][num_counts];
+};
+
+// The statistics of all threads.
+// Never deleted, threads might exit after the static destructors ran.
+struct StatsRegistry
+{
+    StatsRegistry()
+    {
+        memset(exited, 0, sizeof(exited));
+        memset(reset, 0, sizeof(reset));
+    }
+
+    // Total of all threads, call with mutex locked
+    void getTotal(Counts &sum) const
+    {
+        memcpy(sum, exited, sizeof(sum));
+        std::set<const ThreadStats *>::const_iterator i;
+        for (i = threads.begin(); i != threads.end(); ++i)
+            (*i)->addTo(sum);
+    }
+
+    std::mutex mutex; // protects the fields below
+    std::set<const ThreadStats *> threads;
+    Counts exited; // counts of the threads that exited
+    Counts reset;  // total at the last resetStats()
+};
+
+static StatsRegistry &registry()
+{
+    static StatsRegistry *stats = new StatsRegistry();
+    return *stats;
+}
+
+static thread_local ThreadStats thread_stats;
+
+ThreadStats::ThreadStats()
+{
+    for (int m=0; m<FileReader::num_methods; ++m)
+        for (int c=0; c<num_counts; ++c)
+            counts[m][c] = 0;
+    StatsRegistry &all = registry();
+    std::lock_guard<std::mutex> guard(all.mutex);
+    all.threads.insert(this);
+}
+
+ThreadStats::~ThreadStats()
+{
+    StatsRegistry &all = registry();
+    std::lock_guard<std::mutex> guard(all.mutex);
+    addTo(all.exited);
+    all.threads.erase(this);
+}
+
+void ThreadStats::addTo(Counts &sum) const
+{
+    for (int m=0; m<FileReader::num_methods; ++m)
+        for (int c=0; c<num_counts; ++c)
+            sum[m][c] += counts[m][c].load(std::memory_order_relaxed);
+}
+
+static const char *method_names[FileReader::num_methods] =
+{
+    "stdio", "pread", "mmap"
+};
+
+static FileReader::Method initialMethod()
+{
+    FileReader::Method method = FileReader::Mmap;
+    const char *name = getenv("ARCHIVE_READ_METHOD");
+    if (name)
+        FileReader::parseMethod(name, method);
+    return method;
+}
+
+static std::atomic<int> &defaultMethod()
+{
+    static std::atomic<int> method(initialMethod());
+    return method;
+}
+
+// fseeko/fread on the shared FILE
+class StdioFileReader : public FileReader
+{
+public:
+    StdioFileReader(FILE *file) : FileReader(Stdio), file(file) {}
+
+protected:
+    bool readAt(uint64_t offset, void *buffer, size_t size)
+    {
+        return fseeko(file, (off_t) offset, SEEK_SET) == 0  &&
+            fread(buffer, size, 1, file) == 1;
+    }
+
+private:
+    FILE *file;
+};
+
+#ifndef WIN32
+
+// pread on the file descriptor
+class PreadFileReader : public FileReader
+{
+public:
+    PreadFileReader(FILE *file, Method method = Pread)
+        : FileReader(method), fd(fileno(file)) {}
+
+protected:
+    bool readAt(uint64_t offset, void *buffer, size_t size)
+    {
+        char *mem = (char *) buffer;
+        while (size > 0)
+        {
+            ssize_t got = pread(fd, mem, size, (off_t) offset);
+            if (got < 0  &&  errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            mem += got;
+            size -= got;
+            offset += got;
+        }
+        return true;
+    }
+
+private:
+    int fd;
+};
+
+// Copy from the mapped file, pread what's beyond the mapping
+class MmapFileReader : public PreadFileReader
+{
+public:
+    MmapFileReader(FILE *file) : PreadFileReader(file, Mmap) {}
+
+    bool map(FILE *file)
+    {   return mapping.map(file); }
+
+protected:
+    bool readAt(uint64_t offset, void *buffer, size_t size)
+    {
+        const char *mem = 0;
+        if (offset == (uint64_t) (size_t) offset)
+            mem = mapping.get((size_t) offset, size);
+        if (!mem)
+            return PreadFileReader::readAt(offset, buffer, size);
+        memcpy(buffer, mem, size);
+        return true;
+    }
+
+private:
+    MappedFile mapping;
+};
+
+#endif
+
+FileReader::~FileReader()
+{
+}
+
+FileReader *FileReader::create(FILE *file, bool for_write)
+{
+    Method method = for_write ? Stdio : getDefaultMethod();
+#ifndef WIN32
+    if (method == Mmap)
+    {
+        AutoPtr<MmapFileReader> reader(new MmapFileReader(file));
+        if (reader->map(file))
+            return reader.release();
+        method = Pread;
+    }
+    if (method == Pread)
+        return new PreadFileReader(file);
+#endif
+    return new StdioFileReader(file);
+}
+
+bool FileReader::read(uint64_t offset, void *buffer, size_t size)
+{
+    ThreadStats &stats = thread_stats;
+    stats.add(method, count_reads, 1);
+    stats.add(method, count_bytes, size);
+    size_t bucket = 0, limit = 64;
+    while (bucket < size_buckets-1  &&  size >= limit)
+    {
+        ++bucket;
+        limit *= 4;
+    }
+    stats.add(method, count_sizes + bucket, 1);
+    if (size == 0)
+        return true;
+    return readAt(offset, buffer, size);
+}
+
+void FileReader::setDefaultMethod(Method method)
+{
+    defaultMethod() = method;
+}
+
+FileReader::Method FileReader::getDefaultMethod()
+{
+    return (Method) defaultMethod().load();
+}
+
+const char *FileReader::getName(Method method)
+{
+    return method_names[method];
+}
+
+bool FileReader::parseMethod(const char *name, Method &method)
+{
+    for (int i=0; i<num_methods; ++i)
+    {
+        if (strcmp(name, method_names[i]) == 0)
+        {
+            method = (Method) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileReader::getStats(Method method, Stats &stats)
+{
+    StatsRegistry &all = registry();
+    std::lock_guard<std::mutex> guard(all.mutex);
+    Counts total;
+    all.getTotal(total);
+    const size_t *count = total[method], *reset = all.reset[method];
+    stats.reads = count[count_reads] - reset[count_reads];
+    stats.bytes = count[count_bytes] - reset[count_bytes];
+    for (int i=0; i<size_buckets; ++i)
+        stats.sizes[i] = count[count_sizes + i] - reset[count_sizes + i];
+}
+
+void FileReader::resetStats()
+{
+    StatsRegistry &all = registry();
+    std::lock_guard<std::mutex> guard(all.mutex);
+    all.getTotal(all.reset);
+}
@@ -0,0 +1,116 @@
+// -*- c++ -*-
+
+#ifndef __FILE_READER_H__
+#define __FILE_READER_H__
+
+// System
+#include <stdio.h>
+#include <stdint.h>
+// Tool
+#include <NoCopy.h>
+
+/// \ingroup Tools
+
+/// Reads from a file at given offsets.
+///
+/// Unlike fseek()/fread(), a read does not depend on
+/// a file position that's shared by all users of the FILE.
+/// There are several implementations, see Method.
+/// Which one create() uses can be selected at runtime,
+/// and every read is counted in per-method statistics.
+class FileReader
+{
+public:
+    /// How a FileReader reads the file.
+    ///
+    /// - Stdio: fseeko() and fread() on the FILE, using its buffer.
+    ///   Not to be shared between threads.
+    /// - Pread: pread() on the file descriptor without buffering.
+    ///   One reader can be used by several threads at once.
+    /// - Mmap: copies from a memory map of the file, see MappedFile,
+    ///   which is re-mapped when the file grows,
+    ///   so it's not to be shared between threads.
+    ///   Reads beyond the mapping fall back to pread().
+    enum Method { Stdio, Pread, Mmap };
+
+    /// Number of Method values
+    enum { num_methods = 3 };
+
+    /// Number of read size ranges in Stats.
+    enum { size_buckets = 8 };
+
+    /// Read statistics.
+    struct Stats
+    {
+        size_t reads; ///< Number of reads
+        size_t bytes; ///< Total bytes read
+        /// Number of reads by size:
+        /// sizes[i] counts reads of less than 64*4^i bytes,
+        /// the last entry all larger reads.
+        size_t sizes[size_buckets];
+    };
+
+    virtual ~FileReader();
+
+    /// Create a reader for a file.
+    ///
+    /// The file needs to stay open while the reader is used.
+    /// Files opened for writing always get a Stdio reader,
+    /// because the other methods would miss data that's still
+    /// in the FILE buffer.
+    /// Otherwise the default method is used, falling back to
+    /// Pread if the file cannot be mapped,
+    /// and to Stdio where pread() is not available.
+    ///
+    /// @return Alloc'ed FileReader, to be deleted by caller.
+    static FileReader *create(FILE *file, bool for_write);
+
+    /// Read 'size' bytes at 'offset' into buffer.
+    ///
+    /// @return Returns false on error, which includes
+    ///         reading beyond the end of the file.
+    bool read(uint64_t offset, void *buffer, size_t size);
+
+    /// The method used by this reader.
+    Method getMethod() const
+    {   return method; }
+
+    /// Set the method for readers created from now on.
+    ///
+    /// The default is Mmap, unless the environment variable
+    /// ARCHIVE_READ_METHOD names another one,
+    /// see parseMethod().
+    static void setDefaultMethod(Method method);
+
+    /// Get the method for readers created from now on.
+    static Method getDefaultMethod();
+
+    /// Name of a method: "stdio", "pread" or "mmap".
+    static const char *getName(Method method);
+
+    /// Get the method for a name as returned by getName().
+    ///
+    /// @return Returns false for an unknown name.
+    static bool parseMethod(const char *name, Method &method);
+
+    /// Get the read statistics of all readers with a method.
+    ///
+    /// Every thread counts its reads on its own,
+    /// this adds up the counts of all threads.
+    static void getStats(Method method, Stats &stats);
+
+    /// Reset the read statistics of all methods.
+    static void resetStats();
+
+protected:
+    FileReader(Method method) : method(method) {}
+
+    /// Implementation of read() for size > 0.
+    virtual bool readAt(uint64_t offset, void *buffer, size_t size) = 0;
+
+private:
+    PROHIBIT_DEFAULT_COPY(FileReader);
+    Method method;
+};
+
+#endif
@@ -0,0 +1,71 @@
+// System
+#include <string.h>
+// C++
+#include <thread>
+// Tools
+#include "AutoFilePtr.h"
+#include "AutoPtr.h"
+#include "FileReader.h"
+#include "UnitTest.h"
+
+static const char *name = "test.read";
+
+TEST_CASE file_reader()
+{
+    FileReader::Method method, initial = FileReader::getDefaultMethod();
+    TEST(FileReader::parseMethod("pread", method) && method == FileReader::Pread);
+    TEST(! FileReader::parseMethod("carrier pigeon", method));
+    AutoFilePtr file(name, "w+b");
+    TEST(file);
+    TEST(fwrite("Hello, World", 12, 1, file) == 1);
+    fflush(file);
+    FileReader::resetStats();
+    char buffer[20];
+    for (int m=0; m<FileReader::num_methods; ++m)
+    {
+        method = (FileReader::Method) m;
+        FileReader::setDefaultMethod(method);
+        printf("Method '%s'\n", FileReader::getName(method));
+        AutoPtr<FileReader> reader(FileReader::create(file, false));
+        TEST(reader->getMethod() == method);
+        memset(buffer, 0, sizeof(buffer));
+        TEST(reader->read(7, buffer, 5));
+        TEST(strcmp(buffer, "World") == 0);
+        TEST(reader->read(0, buffer, 5));
+        TEST(memcmp(buffer, "Hello", 5) == 0);
+        TEST(reader->read(12, buffer, 0));
+        TEST(! reader->read(10, buffer, 5));
+        FileReader::Stats stats;
+        FileReader::getStats(method, stats);
+        TEST(stats.reads == 4);
+        TEST(stats.bytes == 15);
+        TEST(stats.sizes[0] == 4);
+    }
+    // Reads of other threads are counted, also once the thread exited
+    FileReader::setDefaultMethod(FileReader::Pread);
+    {
+        AutoPtr<FileReader> reader(FileReader::create(file, false));
+        std::thread thread([&reader]()
+        {
+            char hello[5];
+            reader->read(0, hello, 5);
+            reader->read(0, hello, 5);
+        });
+        thread.join();
+        FileReader::Stats stats;
+        FileReader::getStats(FileReader::Pread, stats);
+        TEST(stats.reads == 6);
+        TEST(stats.bytes == 25);
+        FileReader::resetStats();
+        FileReader::getStats(FileReader::Pread, stats);
+        TEST(stats.reads == 0);
+        TEST(stats.bytes == 0);
+    }
+    FileReader::setDefaultMethod(initial);
+    // Files for writing use stdio
+    AutoPtr<FileReader> writer(FileReader::create(file, true));
+    TEST(writer->getMethod() == FileReader::Stdio);
+    file.close();
+    TEST(remove(name) == 0);
+    TEST_OK;
+}
@@ -0,0 +1,82 @@
+// MappedFile.cpp: implementation of the MappedFile class.
+
+// System
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Tools
+#include "MappedFile.h"
+
+#ifdef WIN32
+
+bool MappedFile::map(FILE *file)
+{
+    return false;
+}
+
+void MappedFile::unmap()
+{
+}
+
+bool MappedFile::grow(size_t needed)
+{
+    return false;
+}
+
+#else
+
+bool MappedFile::map(FILE *file)
+{
+    unmap();
+    fd = dup(fileno(file));
+    if (fd < 0)
+        return false;
+    if (!grow(1))
+    {   // Could be an empty file, try again on the first get()
+        struct stat st;
+        if (fstat(fd, &st) != 0  ||  st.st_size > 0)
+        {
+            unmap();
+            return false;
+        }
+    }
+    remaps = 0;
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if (mem)
+        munmap((void *) mem, length);
+    mem = 0;
+    length = 0;
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+}
+
+bool MappedFile::grow(size_t needed)
+{
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0  ||  (size_t) st.st_size < needed)
+        return false;
+    void *new_mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (new_mem == MAP_FAILED)
+        return false; // Keep what we had
+    if (mem)
+    {
+        munmap((void *) mem, length);
+        ++remaps;
+    }
+    mem = (const char *) new_mem;
+    length = st.st_size;
+    return true;
+}
+
+#endif
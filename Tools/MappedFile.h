@@ -0,0 +1,82 @@
+// -*- c++ -*-
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+// System
+#include <stdio.h>
+// Tool
+#include <NoCopy.h>
+
+/// \ingroup Tools
+
+/// Read-only memory map of a file that might still grow.
+///
+/// The whole file is mapped. When get() asks for bytes beyond
+/// the end of the mapping, the file size is checked again,
+/// and if another program appended to the file, it is re-mapped.
+///
+/// The file must not shrink while it's mapped,
+/// because accessing the lost pages would crash the program.
+/// Not supported on WIN32, where map() always fails.
+class MappedFile
+{
+public:
+    MappedFile() : fd(-1), mem(0), length(0), remaps(0) {}
+
+    /// Destructor unmaps the file.
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    /// Map a file.
+    ///
+    /// The file only needs to stay open for the call,
+    /// the MappedFile keeps its own file descriptor.
+    ///
+    /// @return Returns false if the file cannot be mapped.
+    bool map(FILE *file);
+
+    /// Unmap the current file (if any).
+    void unmap();
+
+    /// Is there a mapped file?
+    bool isMapped() const
+    {   return fd >= 0; }
+
+    /// Get 'size' bytes at 'offset' in the file.
+    ///
+    /// @return Returns pointer into the mapping or 0 if the file
+    ///         is not mapped or too short.
+    ///         Valid until the next call to get() or unmap().
+    const char *get(size_t offset, size_t size)
+    {
+        if (offset + size < offset)
+            return 0;
+        if (offset + size > length  &&  !grow(offset + size))
+            return 0;
+        return mem + offset;
+    }
+
+    /// Number of bytes currently mapped.
+    size_t size() const
+    {   return length; }
+
+    /// Number of times the file was re-mapped because it grew.
+    size_t getRemaps() const
+    {   return remaps; }
+
+private:
+    PROHIBIT_DEFAULT_COPY(MappedFile);
+
+    // Re-map if the file grew to at least 'needed' bytes.
+    bool grow(size_t needed);
+
+    int fd;
+    const char *mem;
+    size_t length;
+    size_t remaps;
+};
+
+#endif
@@ -0,0 +1,46 @@
+// System
+#include <string.h>
+// Tools
+#include "AutoFilePtr.h"
+#include "MappedFile.h"
+#include "UnitTest.h"
+
+static const char *name = "test.map";
+
+TEST_CASE mapped_file()
+{
+    MappedFile map;
+    TEST(! map.isMapped());
+    TEST(map.get(0, 1) == 0);
+    // Empty file can be mapped, but has no data
+    AutoFilePtr file(name, "w+b");
+    TEST(file);
+    TEST(map.map(file));
+    TEST(map.size() == 0);
+    TEST(map.get(0, 1) == 0);
+    // Appended data is found
+    TEST(fwrite("Hello", 5, 1, file) == 1);
+    fflush(file);
+    const char *mem = map.get(0, 5);
+    TEST(mem != 0);
+    TEST(mem && memcmp(mem, "Hello", 5) == 0);
+    TEST(map.size() == 5);
+    TEST(map.get(3, 3) == 0);
+    // .. also after the file grew once more
+    TEST(fwrite(", World", 7, 1, file) == 1);
+    fflush(file);
+    mem = map.get(7, 5);
+    TEST(mem && memcmp(mem, "World", 5) == 0);
+    TEST(map.size() == 12);
+    TEST(map.getRemaps() == 1);
+    TEST(map.get(10, (size_t) -1) == 0);
+    // Map stays when the file is closed
+    file.close();
+    mem = map.get(0, 12);
+    TEST(mem && memcmp(mem, "Hello, World", 12) == 0);
+    map.unmap();
+    TEST(! map.isMapped());
+    TEST(map.get(0, 1) == 0);
+    TEST(remove(name) == 0);
+    TEST_OK;
+}
@@ -1,6 +1,7 @@
 // System
 #include <stdarg.h>
 #include <stdio.h>
+#include <mutex>
 // Tools
 #include "MsgLogger.h"
 #include "GenericException.h"
@@ -76,6 +77,10 @@ void MsgLogger::deleteDefaultLogger()
 
 void LOG_MSG(const char *format, va_list ap)
 {
+    // Readers in several threads may log at once,
+    // don't create the default logger twice or mix their lines.
+    static std::mutex log_mutex;
+    std::lock_guard<std::mutex> guard(log_mutex);
     if (MsgLogger::TheMsgLogger == 0)
         // Initialize when first used
         MsgLogger::createDefaultLogger();
@@ -31,6 +31,8 @@ extern TEST_CASE test_ca();
 extern TEST_CASE test_conversions();
 // Unit FUXTest:
 extern TEST_CASE test_fux();
+// Unit FileReaderTest:
+extern TEST_CASE file_reader();
 // Unit FilenameTest:
 extern TEST_CASE Filename_Test();
 // Unit GenericExceptionTest:
@@ -49,6 +51,8 @@ extern TEST_CASE test_concurrent_list();
 extern TEST_CASE test_list();
 // Unit LockfileTest:
 extern TEST_CASE test_lockfile();
+// Unit MappedFileTest:
+extern TEST_CASE mapped_file();
 // Unit MsgLoggerTest:
 extern TEST_CASE test_log();
 // Unit OrderedMutexTest:
@@ -277,6 +281,22 @@ int main(int argc, const char *argv[])
                 printf("THERE WERE ERRORS!\n");
        }
     }
+    if (single_unit==0  ||  strcmp(single_unit, "FileReaderTest")==0)
+    {
+        printf("======================================================================\n");
+        printf("Unit FileReaderTest:\n");
+        printf("----------------------------------------------------------------------\n");
+        ++units;
+       if (single_case==0  ||  strcmp(single_case, "file_reader")==0)
+       {
+            ++run;
+            printf("\nfile_reader:\n");
+            if (file_reader())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+    }
     if (single_unit==0  ||  strcmp(single_unit, "FilenameTest")==0)
     {
         printf("======================================================================\n");
@@ -427,6 +447,22 @@ int main(int argc, const char *argv[])
                 printf("THERE WERE ERRORS!\n");
        }
     }
+    if (single_unit==0  ||  strcmp(single_unit, "MappedFileTest")==0)
+    {
+        printf("======================================================================\n");
+        printf("Unit MappedFileTest:\n");
+        printf("----------------------------------------------------------------------\n");
+        ++units;
+       if (single_case==0  ||  strcmp(single_case, "mapped_file")==0)
+       {
+            ++run;
+            printf("\nmapped_file:\n");
+            if (mapped_file())
+                ++passed;
+            else
+                printf("THERE WERE ERRORS!\n");
+       }
+    }
     if (single_unit==0  ||  strcmp(single_unit, "MsgLoggerTest")==0)
     {
         printf("======================================================================\n");
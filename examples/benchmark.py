@@ -0,0 +1,64 @@
+"""
+Micro-benchmark of the per-call and per-row overhead of archiveexport.
+
+Runs many tiny queries and a few large ones against an index and prints the
+best time of each case, e.g.
+
+    python3 benchmark.py /path/to/index CHANNEL:NAME --start 2021-01-01T00:00:00 --minutes 10
+"""
+import archiveexport as ae
+import argparse
+import datetime
+import timeit
+
+
+def bench(name, stmt, number, repeat):
+    best = min(timeit.repeat(stmt, number=number, repeat=repeat))
+    print("{:<32} {:>10.1f} us/call".format(name, best / number * 1e6))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("index_name")
+    parser.add_argument("channel")
+    parser.add_argument("--start", type=datetime.datetime.fromisoformat, required=True)
+    parser.add_argument("--minutes", type=float, default=10.0)
+    parser.add_argument("--number", type=int, default=200)
+    parser.add_argument("--repeat", type=int, default=5)
+    args = parser.parse_args()
+
+    index_name, channels = args.index_name, [args.channel]
+    start = args.start
+    end = start + datetime.timedelta(minutes=args.minutes)
+    tiny_end = start + datetime.timedelta(microseconds=1)
+
+    rows = len(ae.get_data(index_name=index_name, channels=channels, start=start, end=end)[args.channel])
+    print("{} rows in the large range\n".format(rows))
+
+    archive = ae.Archive(index_name)
+
+    # call overhead, the range holds at most one sample
+    bench("get_data tiny", lambda: ae.get_data(index_name=index_name, channels=channels, start=start, end=tiny_end),
+          args.number, args.repeat)
+    bench("Archive.get_data tiny", lambda: archive.get_data(channels=channels, start=start, end=tiny_end),
+          args.number, args.repeat)
+    bench("estimate tiny", lambda: ae.estimate(index_name=index_name, channels=channels, start=start, end=tiny_end),
+          args.number, args.repeat)
+
+    # row conversion, the cost per row dominates
+    number = max(1, args.number // 20)
+    bench("get_data rows", lambda: archive.get_data(channels=channels, start=start, end=end),
+          number, args.repeat)
+    bench("get_data rows, all keys", lambda: archive.get_data(channels=channels, start=start, end=end,
+                                                              get_units=True, get_status=True, get_info=True),
+          number, args.repeat)
+    bench("get_data rows, layout=segments", lambda: archive.get_data(channels=channels, start=start, end=end,
+                                                                     get_units=True, get_status=True, get_info=True,
+                                                                     layout="segments"),
+          number, args.repeat)
+    bench("iter_data rows", lambda: sum(1 for _ in archive.iter_data(channels=channels, start=start, end=end)),
+          number, args.repeat)
+
+
+if __name__ == "__main__":
+    main()